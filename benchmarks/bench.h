@@ -0,0 +1,112 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <print>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/// minimal timing helpers shared by the qk benchmark executables, kept dependency free so the
+/// benchmarks build anywhere qk builds
+#define QK_BENCH_STRINGIZE_(x) #x
+#define QK_BENCH_STRINGIZE(x) QK_BENCH_STRINGIZE_(x)
+
+namespace qk::bench {
+
+/// how results are printed, 'json' writes one json object per line so results of different qk
+/// versions can be collected and compared by scripts
+enum class output_format { text, json };
+
+inline output_format& format() {
+    static output_format f = output_format::text;
+    return f;
+}
+
+/// parses the arguments shared by all benchmark executables, '--json' switches to json lines, then
+/// prints a header describing the run, 'suite' names the executable
+inline void init(std::string_view suite, size_t samples, int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (std::string_view(argv[i]) == "--json") format() = output_format::json;
+    }
+
+#if defined(__clang__)
+    std::string_view compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+    std::string_view compiler = "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+    std::string_view compiler = "msvc " QK_BENCH_STRINGIZE(_MSC_FULL_VER);
+#else
+    std::string_view compiler = "unknown";
+#endif
+
+    if (format() == output_format::json) {
+        std::println(
+            "{{\"suite\":\"{}\",\"compiler\":\"{}\",\"hardware_threads\":{},\"samples\":{}}}",
+            suite, compiler, std::thread::hardware_concurrency(), samples
+        );
+    } else {
+        std::println(
+            "{} benchmarks, {}, {} hardware threads, median of {} samples", suite, compiler,
+            std::thread::hardware_concurrency(), samples
+        );
+    }
+}
+
+/// runs 'func' 'samples' times and returns the median wall time of a single run in nanoseconds
+template <typename Func>
+double median_ns(size_t samples, Func&& func) {
+    std::vector<double> times;
+    times.reserve(samples);
+
+    for (size_t i = 0; i < samples; i++) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+    }
+
+    std::ranges::sort(times);
+    return times[times.size() / 2];
+}
+
+/// cpu time used by the whole process so far in nanoseconds, on windows 'std::clock' measures wall
+/// time instead so the cpu column there only shows the wall time again
+inline double process_cpu_ns() { return double(std::clock()) * 1e9 / CLOCKS_PER_SEC; }
+
+/// prints a single result line, 'ops' is the number of operations performed by one sample
+inline void report(std::string_view name, double sample_ns, size_t ops) {
+    if (format() == output_format::json) {
+        std::println(
+            "{{\"name\":\"{}\",\"ns_per_op\":{:.1f},\"ops_per_s\":{:.0f}}}", name,
+            sample_ns / ops, ops * 1e9 / sample_ns
+        );
+        return;
+    }
+    std::println(
+        "{:<48} {:>12.1f} ns/op {:>14.0f} ops/s", name, sample_ns / ops, ops * 1e9 / sample_ns
+    );
+}
+
+/// same as 'report' but also prints the cpu time spent per operation across all threads, a cpu
+/// time above the wall time means threads were burning cycles while waiting
+inline void report_cpu(std::string_view name, double sample_ns, double sample_cpu_ns, size_t ops) {
+    if (format() == output_format::json) {
+        std::println(
+            "{{\"name\":\"{}\",\"ns_per_op\":{:.1f},\"ops_per_s\":{:.0f},"
+            "\"cpu_ns_per_op\":{:.1f}}}",
+            name, sample_ns / ops, ops * 1e9 / sample_ns, sample_cpu_ns / ops
+        );
+        return;
+    }
+    std::println(
+        "{:<48} {:>12.1f} ns/op {:>14.0f} ops/s {:>12.1f} cpu ns/op", name, sample_ns / ops,
+        ops * 1e9 / sample_ns, sample_cpu_ns / ops
+    );
+}
+
+}  // namespace qk::bench
+
+#endif  // BENCH_H
@@ -0,0 +1,212 @@
+#include <qk/qk_events.h>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <format>
+#include <mutex>
+#include <reflect>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "bench.h"
+
+using namespace qk::events;
+using namespace qk::bench;
+
+constexpr size_t samples = 21;
+constexpr size_t publishes = 100000;
+
+// the bus as it was before the dense event index, every publish locks and hashes the type id,
+// kept as a baseline for 'bench_publish'
+struct map_bus {
+    struct subscriber {
+        event_cb cb;
+        int id;
+    };
+
+    std::mutex mu;
+    std::unordered_map<size_t, std::vector<subscriber>> subscribers;
+    int id_counter = 0;
+
+    template <typename Event>
+    int subscribe(event_cb callback) {
+        std::lock_guard l(mu);
+        subscribers[reflect::type_id<Event>()].push_back({std::move(callback), ++id_counter});
+        return id_counter;
+    }
+
+    // scans every type and erases from the middle, like the bus did before subscription handles
+    void unsubscribe(int id) {
+        std::lock_guard l(mu);
+        for (auto& [type, subs] : subscribers) {
+            auto it = std::ranges::find(subs, id, &subscriber::id);
+            if (it != subs.end()) {
+                subs.erase(it);
+                return;
+            }
+        }
+    }
+
+    template <typename Event>
+    void publish(Event event) {
+        std::lock_guard l(mu);
+        for (const auto& sub : subscribers[reflect::type_id(event)]) {
+            sub.cb(&event);
+        }
+    }
+};
+
+template <int N>
+struct ev {
+    int v;
+};
+
+// one entry per event type, so the benchmark can cycle through many types at runtime
+template <typename Bus>
+using publish_fn = void (*)(Bus&, int);
+
+template <int N>
+void publish_map(map_bus& bus, int v) {
+    bus.publish(ev<N>{v});
+}
+
+template <int N>
+void publish_dense(EventBus& bus, int v) {
+    publish(ev<N>{v}, &bus);
+}
+
+template <int N>
+void enqueue_dense(EventBus& bus, int v) {
+    enqueue(ev<N>{v}, &bus);
+}
+
+template <int N>
+void subscribe_map(map_bus& bus, int* sink) {
+    bus.subscribe<ev<N>>([sink](void* data) { *sink += static_cast<ev<N>*>(data)->v; });
+}
+
+template <int N>
+void subscribe_dense(EventBus& bus, int* sink) {
+    subscribe<ev<N>>([sink](const ev<N>& e) { *sink += e.v; }, &bus);
+}
+
+template <size_t... I>
+auto make_table(std::index_sequence<I...>) {
+    struct table {
+        std::array<publish_fn<map_bus>, sizeof...(I)> publish_map;
+        std::array<publish_fn<EventBus>, sizeof...(I)> publish_dense;
+        std::array<publish_fn<EventBus>, sizeof...(I)> enqueue_dense;
+        std::array<void (*)(map_bus&, int*), sizeof...(I)> subscribe_map;
+        std::array<void (*)(EventBus&, int*), sizeof...(I)> subscribe_dense;
+    };
+    return table{
+        {::publish_map<int(I)>...},
+        {::publish_dense<int(I)>...},
+        {::enqueue_dense<int(I)>...},
+        {::subscribe_map<int(I)>...},
+        {::subscribe_dense<int(I)>...},
+    };
+}
+
+static const auto events_table = make_table(std::make_index_sequence<1000>());
+
+// publishes cycling through 'types' event types, each with one subscriber or with none, the
+// difference between the two shows the cost of finding out nobody listens
+static void bench_publish(size_t types, bool subscribed) {
+    int sink = 0;
+    std::string_view subs = subscribed ? "1 sub" : "0 subs";
+
+    map_bus mb;
+    EventBus db;
+    if (subscribed) {
+        for (size_t i = 0; i < types; i++) {
+            events_table.subscribe_map[i](mb, &sink);
+            events_table.subscribe_dense[i](db, &sink);
+        }
+    }
+
+    double map_ns = median_ns(samples, [&] {
+        for (size_t i = 0; i < publishes; i++) {
+            events_table.publish_map[i % types](mb, int(i));
+        }
+    });
+    report(std::format("publish/map/{} types/{}", types, subs), map_ns, publishes);
+
+    double dense_ns = median_ns(samples, [&] {
+        for (size_t i = 0; i < publishes; i++) {
+            events_table.publish_dense[i % types](db, int(i));
+        }
+    });
+    report(std::format("publish/dense/{} types/{}", types, subs), dense_ns, publishes);
+}
+
+// queues the same events as 'bench_publish' and delivers them with one flush per sample, the
+// queues are warmed up first so the numbers show the steady state without buffer growth
+static void bench_deferred(size_t types) {
+    int sink = 0;
+    EventBus bus;
+    for (size_t i = 0; i < types; i++) {
+        events_table.subscribe_dense[i](bus, &sink);
+    }
+
+    auto run = [&] {
+        for (size_t i = 0; i < publishes; i++) {
+            events_table.enqueue_dense[i % types](bus, int(i));
+        }
+        flush(&bus);
+    };
+    run();
+
+    double ns = median_ns(samples, run);
+    report(std::format("deferred/enqueue+flush/{} types/1 sub", types), ns, publishes);
+}
+
+// subscribes 'count' handlers to one event type and unsubscribes them oldest first, the pattern of
+// many short lived subscriptions, 'types' other event types have a subscriber each
+static void bench_unsubscribe(size_t types, size_t count) {
+    int sink = 0;
+    map_bus mb;
+    EventBus db;
+    for (size_t i = 1; i <= types; i++) {
+        events_table.subscribe_map[i](mb, &sink);
+        events_table.subscribe_dense[i](db, &sink);
+    }
+
+    std::vector<int> ids(count);
+    double map_ns = median_ns(samples, [&] {
+        for (auto& id : ids) {
+            id = mb.subscribe<ev<0>>([&sink](void*) { sink++; });
+        }
+        for (int id : ids) {
+            mb.unsubscribe(id);
+        }
+    });
+    report(std::format("unsubscribe/map/{} types/{} subs", types, count), map_ns, count);
+
+    std::vector<subscription> handles(count);
+    double dense_ns = median_ns(samples, [&] {
+        for (auto& h : handles) {
+            h = subscribe<ev<0>>([&sink](const ev<0>&) { sink++; }, &db);
+        }
+        for (auto h : handles) {
+            unsubscribe(h, &db);
+        }
+    });
+    report(std::format("unsubscribe/dense/{} types/{} subs", types, count), dense_ns, count);
+}
+
+int main(int argc, char** argv) {
+    init("events", samples, argc, argv);
+
+    for (size_t types : {1, 10, 1000}) {
+        bench_publish(types, false);
+        bench_publish(types, true);
+        bench_deferred(types);
+    }
+
+    for (size_t count : {10, 1000}) {
+        bench_unsubscribe(10, count);
+        bench_unsubscribe(999, count);
+    }
+}
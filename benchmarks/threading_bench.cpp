@@ -0,0 +1,381 @@
+#include <qk/qk_threading.h>
+#include <atomic>
+#include <condition_variable>
+#include <format>
+#include <latch>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "bench.h"
+
+using namespace qk::threading;
+using namespace qk::bench;
+
+constexpr size_t samples = 21;
+
+// the unbuffered channel as it was before the direct handoff, every value goes through the queue
+// and each side waits on a shared condition variable, kept as a baseline for 'bench_handoff'
+template <typename T>
+struct cv_rendezvous {
+    std::queue<T> queue;
+    std::mutex mu;
+    std::condition_variable not_empty, not_full;
+    bool closed = false;
+    int senders_waiting = 0;
+    int receivers_waiting = 0;
+
+    cv_rendezvous(size_t) {}
+
+    bool send(T val) {
+        std::unique_lock l(mu);
+        ++senders_waiting;
+        not_empty.notify_one();
+        not_full.wait(l, [this] { return closed || receivers_waiting > 0; });
+        --senders_waiting;
+        if (closed) return false;
+
+        queue.push(std::move(val));
+        not_empty.notify_one();
+        return true;
+    }
+
+    std::optional<T> receive() {
+        std::unique_lock l(mu);
+        ++receivers_waiting;
+        not_full.notify_one();
+        not_empty.wait(l, [this] { return !queue.empty() || (closed && senders_waiting == 0); });
+        --receivers_waiting;
+        if (queue.empty()) return std::nullopt;
+
+        T val = std::move(queue.front());
+        queue.pop();
+        return val;
+    }
+
+    void close() {
+        std::lock_guard l(mu);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+};
+
+static co_task count_down(std::latch& done) {
+    done.count_down();
+    co_return;
+}
+
+// spawns 'tasks' trivial tasks and waits for all of them, so the measured time covers spawning,
+// scheduling and completion of the whole batch
+static void bench_spawn(size_t tasks) {
+    double detached = median_ns(samples, [&] {
+        std::latch done(tasks);
+        for (size_t i = 0; i < tasks; i++) {
+            go([&] { done.count_down(); });
+        }
+        done.wait();
+    });
+    report(std::format("spawn/go/{}", tasks), detached, tasks);
+
+    thread_pool pool;
+    double pooled = median_ns(samples, [&] {
+        std::latch done(tasks);
+        for (size_t i = 0; i < tasks; i++) {
+            go_on(&pool, [&] { done.count_down(); });
+        }
+        done.wait();
+    });
+    report(std::format("spawn/go_on/{}", tasks), pooled, tasks);
+
+    double coroutines = median_ns(samples, [&] {
+        std::latch done(tasks);
+        for (size_t i = 0; i < tasks; i++) {
+            go_co(count_down(done), &pool);
+        }
+        done.wait();
+    });
+    report(std::format("spawn/go_co/{}", tasks), coroutines, tasks);
+}
+
+// bounces a value between two threads, one sample is 'rounds' round trips, so the per op time is
+// the one way handoff latency
+template <typename Channel>
+static void bench_handoff(std::string_view name, size_t capacity) {
+    constexpr size_t rounds = 10000;
+    Channel ping(capacity), pong(capacity);
+
+    std::jthread echo([&] {
+        while (auto val = ping.receive()) {
+            pong.send(*val);
+        }
+    });
+
+    double ns = median_ns(samples, [&] {
+        for (size_t i = 0; i < rounds; i++) {
+            ping.send(int(i));
+            pong.receive();
+        }
+    });
+    ping.close();
+    report(std::format("handoff/{}", name), ns, rounds * 2);
+}
+
+// streams values from one producer to one consumer
+template <typename Channel>
+static void bench_stream(std::string_view name, size_t capacity) {
+    constexpr size_t values = 100000;
+
+    double ns = median_ns(samples, [&] {
+        Channel ch(capacity);
+        std::jthread producer([&] {
+            for (size_t i = 0; i < values; i++) {
+                ch.send(int(i));
+            }
+            ch.close();
+        });
+        while (ch.receive()) {
+        }
+    });
+    report(std::format("stream/{}/cap{}", name, capacity), ns, values);
+}
+
+// 'producers' threads feeding 'consumers' threads through one shared channel, the per op time is
+// the cost of moving one value through under that load
+template <typename Channel>
+static void bench_throughput(
+    std::string_view name, size_t producers, size_t consumers, size_t capacity
+) {
+    constexpr size_t values = 100000;
+    size_t per_producer = values / producers;
+
+    double ns = median_ns(samples, [&] {
+        Channel ch(capacity);
+        std::vector<std::jthread> receivers;
+        for (size_t c = 0; c < consumers; c++) {
+            receivers.emplace_back([&] {
+                while (ch.receive()) {
+                }
+            });
+        }
+
+        {
+            std::vector<std::jthread> senders;
+            for (size_t p = 0; p < producers; p++) {
+                senders.emplace_back([&] {
+                    for (size_t i = 0; i < per_producer; i++) {
+                        ch.send(int(i));
+                    }
+                });
+            }
+        }
+        ch.close();
+    });
+    report(
+        std::format("throughput/{}/cap{}/{}p{}c", name, capacity, producers, consumers), ns,
+        per_producer * producers
+    );
+}
+
+// a source fanning values out to 'workers' goroutines which fan their results back in to a sink,
+// the usual shape of a loading or processing pipeline, the per op time covers two hops per value
+static void bench_pipeline(size_t workers, size_t capacity) {
+    constexpr size_t values = 50000;
+
+    double ns = median_ns(samples, [&] {
+        channel<int> jobs(capacity), results(capacity);
+        wait_group wg;
+        for (size_t w = 0; w < workers; w++) {
+            wg.add();
+            go([&] {
+                while (auto job = jobs.receive()) {
+                    results.send(*job * 2);
+                }
+                wg.done();
+            });
+        }
+
+        // joined before the channels go out of scope
+        std::jthread source([&] {
+            for (size_t i = 0; i < values; i++) {
+                jobs.send(int(i));
+            }
+            jobs.close();
+            wg.wait();
+            results.close();
+        });
+
+        while (results.receive()) {
+        }
+    });
+    report(std::format("pipeline/{}workers/cap{}", workers, capacity), ns, values);
+}
+
+// runs 'pairs' producer and consumer pairs through one channel with the given spin budget, a single
+// pair bouncing values through a capacity 1 channel shows the latency of short waits, many pairs
+// on a larger channel show the cpu burned by spinning under contention
+static void bench_contention(
+    std::string_view name, spin_budget spin, size_t pairs, size_t capacity
+) {
+    constexpr size_t values = 50000;
+    size_t per_producer = values / pairs;
+
+    double cpu_start = process_cpu_ns();
+    double ns = median_ns(samples, [&] {
+        channel<int> ch(capacity, spin);
+        std::vector<std::jthread> receivers;
+        for (size_t c = 0; c < pairs; c++) {
+            receivers.emplace_back([&] {
+                while (ch.receive()) {
+                }
+            });
+        }
+
+        {
+            std::vector<std::jthread> senders;
+            for (size_t p = 0; p < pairs; p++) {
+                senders.emplace_back([&] {
+                    for (size_t i = 0; i < per_producer; i++) {
+                        ch.send(int(i));
+                    }
+                });
+            }
+        }
+        ch.close();
+    });
+    double cpu = (process_cpu_ns() - cpu_start) / samples;
+    report_cpu(
+        std::format("contention/{}/{}p{}c/cap{}", name, pairs, pairs, capacity), ns, cpu,
+        per_producer * pairs
+    );
+}
+
+// one producer feeding 'subscribers' consumers that each see every value, either through one
+// 'broadcast_channel' or by sending a copy into one 'channel' per consumer
+static void bench_broadcast(size_t subscribers) {
+    constexpr size_t values = 50000;
+
+    double shared = median_ns(samples, [&] {
+        broadcast_channel<int> ch(1024);
+        std::vector<std::unique_ptr<broadcast_channel<int>::subscriber>> subs;
+        for (size_t i = 0; i < subscribers; i++) {
+            subs.push_back(ch.subscribe());
+        }
+
+        std::vector<std::jthread> readers;
+        for (auto& sub : subs) {
+            readers.emplace_back([s = sub.get()] {
+                while (s->receive()) {
+                }
+            });
+        }
+        for (size_t i = 0; i < values; i++) {
+            ch.send(int(i));
+        }
+        ch.close();
+    });
+    report(std::format("broadcast/broadcast_channel/{}subs", subscribers), shared, values);
+
+    double copied = median_ns(samples, [&] {
+        std::vector<std::unique_ptr<channel<int>>> chans;
+        for (size_t i = 0; i < subscribers; i++) {
+            chans.push_back(std::make_unique<channel<int>>(1024));
+        }
+
+        std::vector<std::jthread> readers;
+        for (auto& ch : chans) {
+            readers.emplace_back([c = ch.get()] {
+                while (c->receive()) {
+                }
+            });
+        }
+        for (size_t i = 0; i < values; i++) {
+            for (auto& ch : chans) {
+                ch->send(int(i));
+            }
+        }
+        for (auto& ch : chans) {
+            ch->close();
+        }
+    });
+    report(std::format("broadcast/channel_per_subscriber/{}subs", subscribers), copied, values);
+}
+
+// streams values through a channel using 'send_n' and 'receive_n' with the given batch size
+static void bench_batch(size_t batch) {
+    size_t rounds = 100000 / batch;
+
+    double ns = median_ns(samples, [&] {
+        channel<int> ch(1024);
+        std::jthread producer([&] {
+            std::vector<int> buf(batch);
+            for (size_t round = 0; round < rounds; round++) {
+                std::span<int> rest(buf);
+                while (!rest.empty()) {
+                    rest = rest.subspan(ch.send_n(rest));
+                }
+            }
+            ch.close();
+        });
+
+        std::vector<int> out(batch);
+        while (ch.receive_n(out)) {
+        }
+    });
+    report(std::format("batch/channel/{}", batch), ns, rounds * batch);
+}
+
+int main(int argc, char** argv) {
+    init("threading", samples, argc, argv);
+
+    for (size_t tasks : {1, 16, 256}) {
+        bench_spawn(tasks);
+    }
+
+    bench_handoff<cv_rendezvous<int>>("unbuffered/cv_rendezvous", 0);
+    bench_handoff<channel<int>>("unbuffered/channel", 0);
+    bench_handoff<channel<int>>("channel", 1);
+    bench_handoff<spsc_channel<int>>("spsc_channel", 1);
+
+    for (size_t capacity : {1, 64, 1024}) {
+        bench_stream<channel<int>>("channel", capacity);
+        bench_stream<spsc_channel<int>>("spsc_channel", capacity);
+    }
+
+    for (auto [pairs, capacity] : {std::pair<size_t, size_t>{1, 1}, {8, 64}}) {
+        bench_contention("park", {0, 0}, pairs, capacity);
+        bench_contention("default", {}, pairs, capacity);
+        bench_contention("spin", {4096, 64}, pairs, capacity);
+    }
+
+    for (size_t batch : {1, 16, 256}) {
+        bench_batch(batch);
+    }
+
+    for (size_t subscribers : {1, 3, 8}) {
+        bench_broadcast(subscribers);
+    }
+
+    constexpr std::pair<size_t, size_t> shapes[] = {{1, 1}, {1, 4}, {4, 1}, {4, 4}};
+    for (size_t capacity : {0, 1, 64, 1024}) {
+        for (auto [producers, consumers] : shapes) {
+            bench_throughput<channel<int>>("channel", producers, consumers, capacity);
+        }
+    }
+
+    for (size_t threads : {2, 8, 16}) {
+        bench_throughput<channel<int>>("channel", threads, threads, 1024);
+        bench_throughput<mpmc_channel<int>>("mpmc_channel", threads, threads, 1024);
+    }
+
+    for (size_t workers : {1, 4, 16}) {
+        bench_pipeline(workers, 0);
+        bench_pipeline(workers, 64);
+    }
+
+    return 0;
+}
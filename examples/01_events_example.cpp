@@ -4,8 +4,8 @@
 /// operate on the idea that types are events
 ///
 /// creating an event is as simple as defining a type, literally any type, and publishing only
-/// requires an instance of that type, all subscribers receive the pointer to that instance, and it
-/// is their job to cast it from void* to Event*
+/// requires an instance of that type, all subscribers receive a const reference to that instance,
+/// subscribers taking a void* are supported too, it is then their job to cast it to Event*
 
 #include <qk/qk_events.h>
 #include <print>
@@ -20,20 +20,16 @@ int main() {
     EventBus eb;
 
     // subscribing is based on types, the core philosophy being that types ARE events
-    int sub_id = subscribe<ExampleEvent>(
-        [](void* e) {
-            auto event = (ExampleEvent*)e;
-            std::print("got event: {}\n", event->data);
-        },
-        &eb
+    subscription sub = subscribe<ExampleEvent>(
+        [](const ExampleEvent& event) { std::print("got event: {}\n", event.data); }, &eb
     );
 
     // publishing a type notifies all the subscribers for that type
     publish(ExampleEvent{69}, &eb);
     publish(ExampleEvent{420}, &eb);
 
-    // subscriber management is based on simple integer ids
-    unsubscribe(sub_id, &eb);
+    // subscriber management is based on the handles returned by subscribe
+    unsubscribe(sub, &eb);
 
     publish(ExampleEvent{2137}, &eb);
 
@@ -1,6 +1,20 @@
 #ifndef QK_THREADING_H
 #define QK_THREADING_H
 
+#include "../../qk/threading/broadcast_channel.h"
+#include "../../qk/threading/context.h"
+#include "../../qk/threading/coroutine.h"
+#include "../../qk/threading/future.h"
 #include "../../qk/threading/gorutines.h"
+#include "../../qk/threading/mpmc_channel.h"
+#include "../../qk/threading/parallel.h"
+#include "../../qk/threading/pipeline.h"
+#include "../../qk/threading/pool.h"
+#include "../../qk/threading/rate_limit.h"
+#include "../../qk/threading/scheduler.h"
+#include "../../qk/threading/select.h"
+#include "../../qk/threading/spsc_channel.h"
+#include "../../qk/threading/stats.h"
+#include "../../qk/threading/timer.h"
 
 #endif  // QK_THREADING_H
@@ -1,5 +1,10 @@
 #include "events.h"
 
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <unordered_map>
+
 #ifdef QK_EVENTS
 
 namespace qk::events {
@@ -19,23 +24,354 @@ namespace qk::events {
 //     return sub.id;
 // }
 
-QK_API void unsubscribe(int id, EventBus* bus) {
+static std::mutex registry_mu;
+static std::unordered_map<size_t, size_t> registry;
+
+QK_API size_t _register_event(size_t type_id) {
+    std::lock_guard l(registry_mu);
+    return registry.try_emplace(type_id, registry.size()).first->second;
+}
+
+// reader slot indices, one per thread that published, returned when the thread exits so the
+// slots of every bus stay in use by live threads only
+static std::mutex reader_ids_mu;
+static std::vector<uint32_t> free_reader_ids;
+static uint32_t next_reader_id = 0;
+
+struct reader_id {
+    uint32_t id;
+
+    reader_id() {
+        std::lock_guard l(reader_ids_mu);
+        if (free_reader_ids.empty()) {
+            id = next_reader_id++;
+        } else {
+            id = free_reader_ids.back();
+            free_reader_ids.pop_back();
+        }
+    }
+
+    ~reader_id() {
+        std::lock_guard l(reader_ids_mu);
+        free_reader_ids.push_back(id);
+    }
+};
+
+static uint32_t this_reader() {
+    thread_local reader_id r;
+    return r.id;
+}
+
+// the snapshots a writer took off the retired list, declared before the lock so they are deleted
+// once 'mu' was released, deleting them destroys handlers, whose captures may subscribe or
+// unsubscribe on the same bus
+struct reclaimed_tables {
+    std::vector<const _subscriber_table*> tables;
+
+    ~reclaimed_tables() {
+        for (auto table : tables) {
+            delete table;
+        }
+    }
+};
+
+// moves the replaced snapshots no publish can still be iterating into 'freed', must be called
+// with 'mu' held
+//
+// a publish announces its epoch before it loads the snapshot, so one that got a replaced snapshot
+// announced an epoch older than the one that replaced it, anything newer than the oldest
+// announced epoch is kept, the rest is unreachable
+static void reclaim(EventBus* bus, reclaimed_tables& freed) {
+    if (bus->_retired.empty() || bus->_unslotted_readers.load() != 0) return;
+
+    uint64_t oldest = UINT64_MAX;
+    for (size_t i = 0; i < EventBus::reader_slots; i++) {
+        uint64_t epoch = bus->_readers[i].epoch.load();
+        if (epoch != 0) oldest = std::min(oldest, epoch);
+    }
+
+    auto end = std::ranges::find_if(bus->_retired, [&](const _retired_table& r) {
+        return r.epoch > oldest;
+    });
+    for (auto it = bus->_retired.begin(); it != end; ++it) {
+        freed.tables.push_back(it->table);
+    }
+    bus->_retired.erase(bus->_retired.begin(), end);
+    bus->_has_retired = !bus->_retired.empty();
+}
+
+// publishes 'next' as the current snapshot, must be called with 'mu' held
+static void replace(EventBus* bus, const _subscriber_table* next, reclaimed_tables& freed) {
+    if (auto old = bus->subscribers.exchange(next)) {
+        bus->_retired.push_back({old, bus->_epoch.fetch_add(1) + 1});
+        bus->_has_retired = true;
+    }
+    reclaim(bus, freed);
+}
+
+// a copy of the current snapshot to build the next one from, must be called with 'mu' held
+static _subscriber_table* copy_table(EventBus* bus) {
+    auto current = bus->subscribers.load();
+    return current ? new _subscriber_table(*current) : new _subscriber_table();
+}
+
+// must be called with 'mu' held, after the snapshot was replaced so a set flag never leads to a
+// snapshot without the subscriber
+static void set_listening(EventBus* bus, size_t index, bool listening) {
+    auto flags = bus->_flags.load(std::memory_order_relaxed);
+    if (!flags || index >= flags->size) {
+        if (!listening) return;
+
+        auto grown = std::make_unique<_event_flags>();
+        grown->size = std::max<size_t>(std::bit_ceil(index + 1), 64);
+        grown->listening = std::make_unique<std::atomic_bool[]>(grown->size);
+        for (size_t i = 0; flags && i < flags->size; i++) {
+            grown->listening[i].store(flags->listening[i].load(std::memory_order_relaxed));
+        }
+
+        flags = grown.get();
+        bus->_flag_arrays.push_back(std::move(grown));
+        flags->listening[index].store(true, std::memory_order_relaxed);
+        bus->_flags.store(flags, std::memory_order_release);
+        return;
+    }
+    flags->listening[index].store(listening, std::memory_order_release);
+}
+
+// a slot for a subscriber at 'position' in the list of its event, must be called with 'mu' held
+static uint32_t take_slot(EventBus* bus, uint32_t position) {
+    uint32_t slot;
+    if (bus->_free_slots.empty()) {
+        slot = uint32_t(bus->_slots.size());
+        bus->_slots.emplace_back();
+    } else {
+        slot = bus->_free_slots.back();
+        bus->_free_slots.pop_back();
+    }
+    bus->_slots[slot].position = position;
+    return slot;
+}
+
+// must be called with 'mu' held, the new generation makes every handle to the slot stale
+static void free_slot(EventBus* bus, uint32_t slot) {
+    bus->_slots[slot].generation++;
+    bus->_free_slots.push_back(slot);
+}
+
+// frees the slots of every live subscriber of 'index' and forgets its counts, must be called with
+// 'mu' held
+static void free_slots(EventBus* bus, size_t index, const std::vector<Subscriber>* subs) {
+    if (!subs) return;
+    for (const auto& sub : *subs) {
+        if (!sub.removed.load(std::memory_order_relaxed)) free_slot(bus, sub.slot);
+    }
+
+    bus->_live -= bus->_counts[index].live;
+    bus->_removed -= bus->_counts[index].removed;
+    bus->_counts[index] = {};
+}
+
+// a copy of the list of 'index' without its removed subscribers, with room for 'extra' more, the
+// moved subscribers are told their new position, must be called with 'mu' held
+static std::shared_ptr<std::vector<Subscriber>> compacted(
+    EventBus* bus, size_t index, const std::vector<Subscriber>* subs, size_t extra
+) {
+    auto live = std::make_shared<std::vector<Subscriber>>();
+    if (!subs) return live;
+
+    auto& counts = bus->_counts[index];
+    live->reserve(counts.live + extra);
+    for (const auto& sub : *subs) {
+        if (sub.removed.load(std::memory_order_relaxed)) continue;
+        bus->_slots[sub.slot].position = uint32_t(live->size());
+        live->push_back(sub);
+    }
+
+    bus->_removed -= counts.removed;
+    counts.removed = 0;
+    return live;
+}
+
+// drops the removed subscribers of every event in one new snapshot, must be called with 'mu' held
+static void compact(EventBus* bus, reclaimed_tables& freed) {
+    auto next = copy_table(bus);
+    for (size_t i = 0; i < next->events.size(); i++) {
+        if (bus->_counts[i].removed == 0) continue;
+
+        auto live = compacted(bus, i, next->events[i].get(), 0);
+        next->events[i] = live->empty() ? nullptr : std::move(live);
+    }
+    replace(bus, next, freed);
+}
+
+EventBus::~EventBus() {
+    {
+        std::lock_guard l(_queues_mu);
+        for (auto& q : _queues) {
+            q->dead = true;
+        }
+    }
+
+    delete subscribers.load();
+    for (auto& r : _retired) {
+        delete r.table;
+    }
+}
+
+QK_API subscription _subscribe(size_t index, event_handler handler, EventBus* bus) {
+    reclaimed_tables freed;
     std::lock_guard l(bus->mu);
 
-    for (const auto& [event, subs] : bus->subscribers) {
-        for (size_t i = 0; i < subs.size(); i++) {
-            if (subs[i].id == id) {
-                bus->subscribers[event].erase(subs.begin() + i);
-                return;
-            }
+    auto next = copy_table(bus);
+    if (next->events.size() <= index) next->events.resize(index + 1);
+    if (bus->_counts.size() <= index) bus->_counts.resize(index + 1);
+
+    // the list is copied anyway, so this is where its removed subscribers are dropped
+    auto& list = next->events[index];
+    auto subs = compacted(bus, index, list.get(), 1);
+
+    Subscriber sub{};
+    sub.cb = std::move(handler);
+    sub.slot = take_slot(bus, uint32_t(subs->size()));
+    subscription handle{index, sub.slot, bus->_slots[sub.slot].generation};
+    subs->emplace_back(std::move(sub));
+    list = std::move(subs);
+    bus->_counts[index].live++;
+    bus->_live++;
+
+    replace(bus, next, freed);
+    set_listening(bus, index, true);
+    return handle;
+}
+
+QK_API void _remove_event(size_t index, EventBus* bus) {
+    reclaimed_tables freed;
+    std::lock_guard l(bus->mu);
+
+    auto current = bus->subscribers.load();
+    if (!current || index >= current->events.size() || !current->events[index]) return;
+
+    set_listening(bus, index, false);
+    free_slots(bus, index, current->events[index].get());
+    auto next = copy_table(bus);
+    next->events[index] = nullptr;
+    replace(bus, next, freed);
+}
+
+QK_API const std::vector<Subscriber>* _begin_read(size_t index, EventBus* bus) {
+    uint32_t id = this_reader();
+    if (id >= EventBus::reader_slots) {
+        bus->_unslotted_readers.fetch_add(1);
+    } else if (auto& slot = bus->_readers[id]; slot.depth++ == 0) {
+        // a nested publish is covered by the epoch of the outermost one
+        slot.epoch.store(bus->_epoch.load());
+    }
+
+    auto table = bus->subscribers.load();
+    if (table && index < table->events.size()) return table->events[index].get();
+    return nullptr;
+}
+
+QK_API void _end_read(EventBus* bus) {
+    uint32_t id = this_reader();
+    if (id >= EventBus::reader_slots) {
+        bus->_unslotted_readers.fetch_sub(1);
+    } else if (auto& slot = bus->_readers[id]; --slot.depth == 0) {
+        slot.epoch.store(0, std::memory_order_release);
+    } else {
+        return;
+    }
+
+    // a publish that leaves may unblock what was replaced while it ran, unless a writer holds the
+    // lock, in which case that writer or the next one frees it
+    if (bus->_has_retired.load()) {
+        reclaimed_tables freed;
+        std::unique_lock l(bus->mu, std::try_to_lock);
+        if (l) reclaim(bus, freed);
+    }
+}
+
+QK_API void _publish(size_t index, const void* data, EventBus* bus) {
+    if (auto subs = _begin_read(index, bus)) {
+        for (const auto& sub : *subs) {
+            if (!sub.removed.load(std::memory_order_relaxed)) sub.cb(data);
         }
     }
+    _end_read(bus);
+}
+
+QK_API void _add_queue(std::shared_ptr<_event_queue> queue, EventBus* bus) {
+    std::lock_guard l(bus->_queues_mu);
+    auto pos = std::ranges::upper_bound(bus->_queues, queue->index, {}, &_event_queue::index);
+    bus->_queues.insert(pos, std::move(queue));
+}
+
+QK_API void flush(EventBus* bus) {
+    std::lock_guard f(bus->_flush_mu);
+    {
+        std::lock_guard l(bus->_queues_mu);
+        bus->_flushing.clear();
+        for (auto& q : bus->_queues) {
+            bus->_flushing.push_back(q.get());
+        }
+    }
+
+    // queues are only removed below, under '_flush_mu', so the raw pointers stay valid
+    for (auto q : bus->_flushing) {
+        q->_flush(q, bus);
+    }
+
+    // the queues of threads that exited can not receive new events, once drained they are done
+    std::lock_guard l(bus->_queues_mu);
+    std::erase_if(bus->_queues, [](const std::shared_ptr<_event_queue>& q) {
+        std::lock_guard ll(q->mu);
+        return q->orphaned && q->pending == 0;
+    });
+}
+
+QK_API void unsubscribe(subscription sub, EventBus* bus) {
+    reclaimed_tables freed;
+    std::lock_guard l(bus->mu);
+
+    // a live generation means the subscriber is in the list of 'sub.event' at 'position'
+    if (sub.slot >= bus->_slots.size() || bus->_slots[sub.slot].generation != sub.generation) {
+        return;
+    }
+    uint32_t position = bus->_slots[sub.slot].position;
+    free_slot(bus, sub.slot);
+
+    // publishes already iterating the list may or may not still call it, like with any change
+    const auto& subs = *bus->subscribers.load()->events[sub.event];
+    subs[position].removed.store(true, std::memory_order_relaxed);
+
+    auto& counts = bus->_counts[sub.event];
+    counts.live--;
+    counts.removed++;
+    bus->_live--;
+    bus->_removed++;
+    if (counts.live == 0) set_listening(bus, sub.event, false);
+
+    // every compaction copies at most the table and the lists of the removed subscribers, waiting
+    // until those outnumber the live subscribers and event types pays for it
+    if (bus->_removed > bus->_live + bus->_counts.size()) compact(bus, freed);
 }
 
 QK_API void unsubscribe_all(EventBus* bus) {
+    reclaimed_tables freed;
     std::lock_guard l(bus->mu);
 
-    bus->subscribers.clear();
+    if (auto current = bus->subscribers.load()) {
+        for (size_t i = 0; i < current->events.size(); i++) {
+            free_slots(bus, i, current->events[i].get());
+        }
+    }
+
+    if (auto flags = bus->_flags.load()) {
+        for (size_t i = 0; i < flags->size; i++) {
+            flags->listening[i].store(false, std::memory_order_relaxed);
+        }
+    }
+    replace(bus, nullptr, freed);
 }
 
 // void remove_event(reflect::detail::any event_type, EventBus* bus) {
@@ -5,11 +5,18 @@
 
 #include <atomic>
 // #include <mp>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <memory>
 #include <mutex>
+#include <new>
 #include <ranges>
 #include <reflect>
-#include <unordered_map>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include "../api.h"
 
@@ -19,38 +26,351 @@
 // look in to that later
 namespace qk::events {
 
+/// the untyped callback, it receives a pointer to the published event and has to cast it itself,
+/// the event must not be modified through it
 using event_cb = std::function<void(void*)>;
 
+/// a copyable type erased handler for one event type, called with a pointer to the event
+///
+/// callables of up to 'inline_size' bytes are stored inline, so captureless lambdas, lambdas
+/// capturing a few pointers and member functions bound to an object never allocate, bigger ones
+/// are moved to the heap
+struct QK_API event_handler {
+    static constexpr size_t inline_size = 4 * sizeof(void*);
+
+    enum class _op { copy, move, destroy };
+
+    alignas(std::max_align_t) std::byte _storage[inline_size];
+    void (*_call)(void* self, const void* event) = nullptr;
+
+    // copies, moves or destroys the stored callable, null when it is stored inline and trivially
+    // copyable, in which case copying the bytes is enough
+    void (*_manage)(_op op, void* dst, void* src) = nullptr;
+
+    template <typename Fn>
+    static constexpr bool _fits_inline = sizeof(Fn) <= inline_size &&
+                                         alignof(Fn) <= alignof(std::max_align_t) &&
+                                         std::is_nothrow_move_constructible_v<Fn>;
+
+    event_handler() = default;
+
+    /// wraps 'fn', which is called with a 'const Event&'
+    template <typename Event, typename F>
+    static event_handler make(F&& fn) {
+        using Fn = std::decay_t<F>;
+        event_handler h;
+
+        if constexpr (_fits_inline<Fn>) {
+            std::construct_at(reinterpret_cast<Fn*>(h._storage), std::forward<F>(fn));
+            h._call = [](void* self, const void* event) {
+                (*std::launder(static_cast<Fn*>(self)))(*static_cast<const Event*>(event));
+            };
+            if constexpr (!std::is_trivially_copyable_v<Fn>) {
+                h._manage = [](_op op, void* dst, void* src) {
+                    auto from = std::launder(static_cast<Fn*>(src));
+                    if (op == _op::copy) std::construct_at(static_cast<Fn*>(dst), *from);
+                    if (op == _op::move) std::construct_at(static_cast<Fn*>(dst), std::move(*from));
+                    if (op != _op::copy) std::destroy_at(from);
+                };
+            }
+        } else {
+            *reinterpret_cast<Fn**>(h._storage) = new Fn(std::forward<F>(fn));
+            h._call = [](void* self, const void* event) {
+                (**static_cast<Fn**>(self))(*static_cast<const Event*>(event));
+            };
+            h._manage = [](_op op, void* dst, void* src) {
+                Fn*& from = *static_cast<Fn**>(src);
+                if (op == _op::copy) *static_cast<Fn**>(dst) = new Fn(*from);
+                if (op == _op::move) *static_cast<Fn**>(dst) = std::exchange(from, nullptr);
+                if (op == _op::destroy) delete from;
+            };
+        }
+        return h;
+    }
+
+    event_handler(const event_handler& other) { _assign(other, _op::copy); }
+    event_handler(event_handler&& other) noexcept { _assign(other, _op::move); }
+
+    event_handler& operator=(const event_handler& other) {
+        if (this != &other) {
+            reset();
+            _assign(other, _op::copy);
+        }
+        return *this;
+    }
+
+    event_handler& operator=(event_handler&& other) noexcept {
+        if (this != &other) {
+            reset();
+            _assign(other, _op::move);
+        }
+        return *this;
+    }
+
+    ~event_handler() { reset(); }
+
+    // takes over the callable of 'other', moving leaves 'other' empty
+    void _assign(const event_handler& other, _op op) {
+        _call = other._call;
+        _manage = other._manage;
+        if (_manage) {
+            _manage(op, _storage, const_cast<std::byte*>(other._storage));
+        } else {
+            std::memcpy(_storage, other._storage, inline_size);
+        }
+
+        if (op == _op::move) {
+            auto& moved = const_cast<event_handler&>(other);
+            moved._call = nullptr;
+            moved._manage = nullptr;
+        }
+    }
+
+    void reset() {
+        if (_manage) _manage(_op::destroy, _storage, _storage);
+        _call = nullptr;
+        _manage = nullptr;
+    }
+
+    explicit operator bool() const { return _call != nullptr; }
+
+    /// calls the handler, like 'std::function' a mutable callable can be called through a const
+    /// handler
+    void operator()(const void* event) const {
+        _call(const_cast<std::byte*>(_storage), event);
+    }
+};
+
 struct QK_API Subscriber {
-    event_cb cb;
-    int id;
+    event_handler cb;
+    uint32_t slot;  // its entry in 'EventBus::_slots'
+
+    // set by 'unsubscribe' in place in the live snapshot, publishes skip the subscriber from then
+    // on and the next compaction of its list drops it
+    mutable std::atomic_bool removed = false;
+
+    Subscriber() = default;
+    Subscriber(const Subscriber& other)
+        : cb(other.cb), slot(other.slot), removed(other.removed.load(std::memory_order_relaxed)) {}
+    Subscriber(Subscriber&& other) noexcept
+        : cb(std::move(other.cb)),
+          slot(other.slot),
+          removed(other.removed.load(std::memory_order_relaxed)) {}
+};
+
+/// identifies one subscriber, returned by 'subscribe' and taken by 'unsubscribe'
+///
+/// a handle never refers to a different subscriber, once its subscriber is gone unsubscribing with
+/// it does nothing, even after the slot was reused by a newer subscription
+struct QK_API subscription {
+    size_t event = 0;
+    uint32_t slot = 0;
+    uint32_t generation = 0;  // never 0 for a live subscriber, so a default handle matches nothing
+
+    bool operator==(const subscription&) const = default;
+};
+
+// where a subscriber currently sits in the list of its event, the generation is bumped every time
+// the slot is freed
+struct QK_API _subscription_slot {
+    uint32_t position = 0;
+    uint32_t generation = 1;
+};
+
+// how many subscribers of one event are live and how many are removed but still in its list
+struct QK_API _subscriber_counts {
+    uint32_t live = 0;
+    uint32_t removed = 0;
+};
+
+// hands out dense event indices, the same type gets the same index in every module of the process
+QK_API size_t _register_event(size_t type_id);
+
+/// the dense index of an event type, assigned the first time the type is used and stable for the
+/// rest of the process, the bus looks subscribers up by it with a plain array access instead of
+/// hashing the type
+template <typename Event>
+size_t event_index() {
+    static const size_t index = _register_event(reflect::type_id<Event>());
+    return index;
+}
+
+// an immutable snapshot of every subscriber indexed by 'event_index', never modified once
+// published, changes build a new one that shares the lists of the event types they do not touch
+struct QK_API _subscriber_table {
+    std::vector<std::shared_ptr<const std::vector<Subscriber>>> events;
+};
+
+// one flag per event index that is set while the event has subscribers, so publishing an event
+// nobody listens to returns before touching the snapshot
+struct QK_API _event_flags {
+    size_t size;
+    std::unique_ptr<std::atomic_bool[]> listening;
+};
+
+// the same padding as 'qk::threading::cache_line_size', the events module does not depend on the
+// threading module
+inline constexpr size_t _cache_line_size = 64;
+
+// where one thread announces the snapshot epoch it is reading, padded so publishes on different
+// threads never write to the same cache line
+struct QK_API _reader_slot {
+    alignas(_cache_line_size) std::atomic<uint64_t> epoch = 0;  // 0 while the thread is not reading
+    uint32_t depth = 0;  // nested publishes of the owning thread, only touched by it
+};
+
+// a replaced snapshot and the epoch that replaced it, it can be freed once no reader announced an
+// older epoch
+struct QK_API _retired_table {
+    const _subscriber_table* table;
+    uint64_t epoch;
+};
+
+// tells buses apart in the per thread queue caches, never reused unlike addresses
+inline std::atomic<uint64_t> _bus_ids = 1;
+
+struct EventBus;
+
+// the events of one type queued by one thread on one bus, see 'enqueue', the type specific part
+// lives in '_queued_events'
+struct QK_API _event_queue {
+    uint64_t bus_id;
+    size_t index;
+
+    // taken by the owning thread on every 'enqueue' and by 'flush' to swap the buffers
+    std::mutex mu;
+    size_t pending = 0;     // under 'mu'
+    bool orphaned = false;  // the thread is gone, under 'mu'
+
+    std::atomic_bool dead = false;  // the bus is gone
+
+    // swaps the buffers and dispatches every event queued so far
+    void (*_flush)(_event_queue* self, EventBus* bus);
+
+    _event_queue(uint64_t bus_id, size_t index, void (*flush)(_event_queue*, EventBus*))
+        : bus_id(bus_id), index(index), _flush(flush) {}
 };
 
 /// the main event bus type, used for all the event operations
+///
+/// the subscribers are kept as a snapshot that is swapped as a whole on every change, so
+/// publishing never locks and runs callbacks concurrently from any number of threads, callbacks
+/// may publish, subscribe and unsubscribe themselves, changes apply to publishes that start
+/// afterwards
 struct QK_API EventBus {
+    // serializes subscribing and unsubscribing, publishing never takes it
     std::mutex mu;
-    std::atomic_int id_counter = 0;
-    std::unordered_map<size_t, std::vector<Subscriber>> subscribers;
+
+    // the slot map behind 'subscription', freed slots are reused through '_free_slots'
+    std::vector<_subscription_slot> _slots;  // under 'mu'
+    std::vector<uint32_t> _free_slots;       // under 'mu'
+
+    // per event index, removed subscribers stay in the snapshot until their list is compacted
+    std::vector<_subscriber_counts> _counts;  // under 'mu'
+    size_t _live = 0;                         // under 'mu'
+    size_t _removed = 0;                      // under 'mu'
+
+    // the current snapshot, null while nothing is subscribed
+    std::atomic<const _subscriber_table*> subscribers = nullptr;
+
+    // bumped every time the snapshot is replaced, a publish announces the epoch it started in
+    // through the slot of its thread, so a replaced snapshot only waits for the publishes that
+    // started before it was replaced
+    static constexpr size_t reader_slots = 64;
+    std::atomic<uint64_t> _epoch = 1;
+    std::unique_ptr<_reader_slot[]> _readers = std::make_unique<_reader_slot[]>(reader_slots);
+
+    // publishes of threads beyond 'reader_slots' only count themselves and hold back every
+    // replaced snapshot while they run
+    alignas(_cache_line_size) std::atomic<size_t> _unslotted_readers = 0;
+
+    std::atomic_bool _has_retired = false;
+    std::vector<_retired_table> _retired;  // under 'mu', oldest first
+
+    // replaced by a bigger copy when a new event type is subscribed to, every copy is kept until
+    // the bus is destroyed so publishing can read them without registering as a reader
+    std::atomic<const _event_flags*> _flags = nullptr;
+    std::vector<std::unique_ptr<_event_flags>> _flag_arrays;  // under 'mu'
+
+    // the queues of 'enqueue', one per producer thread and event type, sorted by event index so
+    // 'flush' dispatches the batches of one type back to back
+    uint64_t _id = _bus_ids.fetch_add(1, std::memory_order_relaxed);
+    std::mutex _queues_mu;
+    std::vector<std::shared_ptr<_event_queue>> _queues;  // under '_queues_mu'
+
+    // serializes 'flush', the list is only reused to avoid allocating on every flush
+    std::mutex _flush_mu;
+    std::vector<_event_queue*> _flushing;  // under '_flush_mu'
+
+    EventBus() = default;
+    ~EventBus();
+
+    EventBus(const EventBus&) = delete;
+    EventBus& operator=(const EventBus&) = delete;
 };
 
+QK_API subscription _subscribe(size_t index, event_handler handler, EventBus* bus);
+QK_API void _remove_event(size_t index, EventBus* bus);
+QK_API void _publish(size_t index, const void* data, EventBus* bus);
+QK_API void _add_queue(std::shared_ptr<_event_queue> queue, EventBus* bus);
+
+// the subscribers of an event at the current snapshot, null if there are none, the snapshot stays
+// valid until the matching '_end_read', which has to run on the same thread
+QK_API const std::vector<Subscriber>* _begin_read(size_t index, EventBus* bus);
+QK_API void _end_read(EventBus* bus);
+
 /// subscribes a new subscriber to an event type, subscribers are not deduplicated
-template <typename Event>
-int subscribe(event_cb callback, EventBus* bus) {
-    std::lock_guard l(bus->mu);
+///
+/// 'handler' is called with a 'const Event&' to the published event, small handlers are stored
+/// without allocating, see 'event_handler'
+///
+///     @code
+///     subscribe<Resized>([&](const Resized& e) { layout(e.width, e.height); }, &bus);
+///     @endcode
+template <typename Event, typename Handler>
+    requires std::invocable<std::decay_t<Handler>&, const Event&>
+subscription subscribe(Handler&& handler, EventBus* bus) {
+    return _subscribe(
+        event_index<Event>(), event_handler::make<Event>(std::forward<Handler>(handler)), bus
+    );
+}
 
-    Subscriber sub{};
-    sub.cb = callback;
+/// same as above with an untyped callback that receives a 'void*' to the event
+template <typename Event>
+subscription subscribe(event_cb callback, EventBus* bus) {
+    return subscribe<Event>(
+        [cb = std::move(callback)](const Event& e) { cb(const_cast<Event*>(&e)); }, bus
+    );
+}
 
-    sub.id = ++bus->id_counter;
-    bus->subscribers[reflect::type_id<Event>()].emplace_back(sub);
+/// subscribes a member function of 'object', the event type is taken from its parameter, 'object'
+/// has to outlive the subscription
+///
+///     @code
+///     subscribe(&Window::on_resize, &window, &bus);
+///     @endcode
+template <typename Event, typename Object>
+subscription subscribe(void (Object::*method)(const Event&), Object* object, EventBus* bus) {
+    return subscribe<Event>([object, method](const Event& e) { (object->*method)(e); }, bus);
+}
 
-    return sub.id;
+template <typename Event, typename Object>
+subscription subscribe(
+    void (Object::*method)(const Event&) const, const Object* object, EventBus* bus
+) {
+    return subscribe<Event>([object, method](const Event& e) { (object->*method)(e); }, bus);
 }
 
 // int subscribe(event_cb callback, reflect::detail::any event_type, EventBus* bus);
 
-/// unsubscribes a specific subscriber using its id, the id can be retrieved when subscribing
-QK_API void unsubscribe(int id, EventBus* bus);
+/// unsubscribes a specific subscriber using the handle returned when subscribing, stale handles
+/// are ignored
+///
+/// the subscriber is found and marked removed in place in constant time, so the remaining ones keep
+/// the order they are called in, removed subscribers are dropped in batches by the next 'subscribe'
+/// to the same event or once they outnumber the live ones, which keeps unsubscribing O(1)
+/// amortized
+QK_API void unsubscribe(subscription sub, EventBus* bus);
 
 /// unsubscribes all subscribers, essentially clearing the event bus
 QK_API void unsubscribe_all(EventBus* bus);
@@ -58,22 +378,118 @@ QK_API void unsubscribe_all(EventBus* bus);
 /// removes an event type from the event bus and unsubscribes all subscribers for that type
 template <typename Event>
 void remove_event(EventBus* bus) {
-    std::lock_guard l(bus->mu);
-    bus->subscribers.erase(reflect::type_id<Event>());
+    _remove_event(event_index<Event>(), bus);
 }
 
 // void remove_event(reflect::detail::any event_type, EventBus* bus);
 
 /// publishes an event, does not check if the type has at least a single subscriber
+///
+/// this is lock free, the callbacks run on the calling thread against the subscribers at the time
+/// of the call, publishing an event without subscribers only reads its flag
+///
+/// the event is passed to the subscribers by reference and never copied, temporaries live until
+/// every subscriber returned
+template <typename Event>
+void publish(const Event& event, EventBus* bus) {
+    size_t index = event_index<Event>();
+    auto flags = bus->_flags.load(std::memory_order_acquire);
+    if (!flags || index >= flags->size) return;
+    if (!flags->listening[index].load(std::memory_order_acquire)) return;
+
+    _publish(index, std::addressof(event), bus);
+}
+
 template <typename Event>
-void publish(Event event, EventBus* bus) {
-    std::lock_guard l(bus->mu);
+struct _queued_events : _event_queue {
+    std::vector<Event> queued;    // under 'mu'
+    std::vector<Event> flushing;  // only touched by 'flush'
+
+    _queued_events(uint64_t bus_id, size_t index) : _event_queue(bus_id, index, &_run) {}
+
+    static void _run(_event_queue* self, EventBus* bus) {
+        auto q = static_cast<_queued_events*>(self);
+        {
+            std::lock_guard l(q->mu);
+            std::swap(q->queued, q->flushing);
+            q->pending = 0;
+        }
+        if (q->flushing.empty()) return;
 
-    for (const auto& sub : bus->subscribers[reflect::type_id(event)]) {
-        sub.cb(&event);
+        if (auto subs = _begin_read(q->index, bus)) {
+            for (const Event& event : q->flushing) {
+                for (const auto& sub : *subs) {
+                    if (!sub.removed.load(std::memory_order_relaxed)) sub.cb(&event);
+                }
+            }
+        }
+        _end_read(bus);
+
+        // keeps the capacity, so once the buffers grew queueing stops allocating
+        q->flushing.clear();
     }
+};
+
+// the queue of this thread for 'Event' on 'bus', created and registered on first use
+template <typename Event>
+_queued_events<Event>& _local_queue(EventBus* bus) {
+    struct cache {
+        std::vector<std::shared_ptr<_queued_events<Event>>> queues;
+
+        ~cache() {
+            for (auto& q : queues) {
+                std::lock_guard l(q->mu);
+                q->orphaned = true;
+            }
+        }
+    };
+    thread_local cache c;
+    for (auto& q : c.queues) {
+        if (q->bus_id == bus->_id) return *q;
+    }
+
+    std::erase_if(c.queues, [](auto& q) { return q->dead.load(); });
+    auto q = std::make_shared<_queued_events<Event>>(bus->_id, event_index<Event>());
+    _add_queue(q, bus);
+    c.queues.push_back(q);
+    return *q;
 }
 
+/// queues an event to be delivered by the next 'flush' instead of right away, so handlers run at
+/// a known point, for example once per frame, and not in the middle of the code that fired it
+///
+///     @code
+///     enqueue(Collision{a, b}, &bus);  // from any system, on any thread
+///     ...
+///     flush(&bus);                     // once per frame, runs every collision handler
+///     @endcode
+///
+/// every thread queues into its own buffer per event type, so producers never wait on each other,
+/// only briefly on a running 'flush' that swaps their buffer out
+template <typename Event>
+void enqueue(const Event& event, EventBus* bus) {
+    auto& q = _local_queue<Event>(bus);
+    std::lock_guard l(q.mu);
+    q.queued.push_back(event);
+    q.pending++;
+}
+
+template <typename Event>
+    requires(!std::is_reference_v<Event>)
+void enqueue(Event&& event, EventBus* bus) {
+    auto& q = _local_queue<Event>(bus);
+    std::lock_guard l(q.mu);
+    q.queued.push_back(std::move(event));
+    q.pending++;
+}
+
+/// delivers every event queued with 'enqueue' so far, all events of one type are dispatched back
+/// to back, and the events of one thread arrive in the order they were queued
+///
+/// events queued while flushing, including from the handlers themselves, are delivered by the
+/// next flush, this must not be called from inside a handler
+QK_API void flush(EventBus* bus);
+
 }  // namespace qk::events
 
 #endif
@@ -0,0 +1,335 @@
+#ifndef BROADCAST_CHANNEL_H
+#define BROADCAST_CHANNEL_H
+
+#ifdef QK_THREADING
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "../api.h"
+#include "sync.h"
+
+namespace qk::threading {
+
+/// what a 'broadcast_channel' does when its slowest subscriber is a full ring behind
+enum class lag_policy {
+    block,   // the sender waits until every subscriber caught up
+    drop,    // the oldest values are overwritten and a lagging subscriber silently skips them
+    report,  // like 'drop', but the lagging subscriber is told how many values it missed
+};
+
+/// a bounded channel where every subscriber receives every value, one shared ring buffer holds
+/// each value once and every subscriber reads it through its own cursor
+///
+/// sending constructs the value in the ring once, no matter how many subscribers there are, and
+/// receiving copies it out, so 'T' has to be copyable, the capacity is rounded up to a power of two
+///
+///     @code
+///     broadcast_channel<tick> ticks(64, lag_policy::report);
+///     auto audio = ticks.subscribe();
+///
+///     go([&] {
+///         while (true) {
+///             auto t = audio->receive();
+///             if (!t && audio->take_missed() > 0) continue;  // fell behind, skip ahead
+///             if (!t) break;                                  // closed
+///             mix(*t);
+///         }
+///     });
+///
+///     ticks.send(tick{frame});
+///     @endcode
+///
+/// a subscriber only sees values sent after it subscribed, each subscriber is meant to be used by
+/// one thread at a time and has to be destroyed before the channel
+template <typename T>
+    requires std::copy_constructible<T>
+struct QK_API broadcast_channel {
+    static constexpr int spin_limit = 64;
+    static constexpr int yield_limit = 16;
+
+    // marks a slot whose old value is being replaced
+    static constexpr uint64_t _writing = UINT64_MAX;
+
+    struct _slot {
+        // position + 1 of the value held, 0 while the slot was never written
+        std::atomic<uint64_t> seq = 0;
+
+        // subscribers currently copying the value out, the sender waits for them before
+        // overwriting it
+        std::atomic<uint32_t> readers = 0;
+
+        alignas(T) std::byte data[sizeof(T)];
+    };
+
+    struct subscriber;
+
+    std::unique_ptr<_slot[]> _slots;
+    size_t _mask = 0;
+    lag_policy _policy;
+    std::atomic_bool _closed = false;
+
+    // serializes senders, so the ring itself only ever has one writer
+    std::mutex _send_mu;
+
+    // position of the next value, every value below it is readable
+    alignas(cache_line_size) std::atomic<uint64_t> _tail = 0;
+
+    // lower bound of the slowest cursor, only used with 'lag_policy::block', written under
+    // '_send_mu'
+    uint64_t _min_cursor = 0;
+
+    std::mutex _subs_mu;
+    std::vector<subscriber*> _subs;
+
+    alignas(cache_line_size) std::atomic<int> _receivers_waiting = 0;
+    std::atomic<uint32_t> _data_signal = 0;
+    alignas(cache_line_size) std::atomic<int> _senders_waiting = 0;
+    std::atomic<uint32_t> _space_signal = 0;
+
+    explicit broadcast_channel(size_t capacity, lag_policy policy = lag_policy::block)
+        : _slots(std::make_unique<_slot[]>(std::bit_ceil(std::max<size_t>(capacity, 1)))),
+          _mask(std::bit_ceil(std::max<size_t>(capacity, 1)) - 1),
+          _policy(policy) {}
+
+    ~broadcast_channel() {
+        for (size_t i = 0; i <= _mask; i++) {
+            if (_slots[i].seq.load() != 0) std::destroy_at(_value(&_slots[i]));
+        }
+    }
+
+    broadcast_channel(const broadcast_channel&) = delete;
+    broadcast_channel& operator=(const broadcast_channel&) = delete;
+
+    static T* _value(_slot* s) { return std::launder(reinterpret_cast<T*>(s->data)); }
+
+    size_t capacity() const { return _mask + 1; }
+
+    static void _wake(std::atomic<int>& waiting, std::atomic<uint32_t>& signal, bool all) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) == 0) return;
+        signal.fetch_add(1, std::memory_order_release);
+        if (all)
+            signal.notify_all();
+        else
+            signal.notify_one();
+    }
+
+    // registers as a waiter and sleeps until 'ready' holds, 'ready' is rechecked after registering
+    // so a wake up can not be missed
+    template <typename Ready>
+    static void _park(std::atomic<int>& waiting, std::atomic<uint32_t>& signal, Ready&& ready) {
+        while (true) {
+            uint32_t seen = signal.load(std::memory_order_acquire);
+            waiting.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (ready()) {
+                waiting.fetch_sub(1);
+                return;
+            }
+
+            signal.wait(seen, std::memory_order_acquire);
+            waiting.fetch_sub(1);
+        }
+    }
+
+    // recomputes '_min_cursor' from the live subscribers, without any it is the tail since nobody
+    // is left to wait for
+    void _refresh_min_cursor(uint64_t tail) {
+        std::lock_guard l(_subs_mu);
+        uint64_t min = tail;
+        for (subscriber* s : _subs) {
+            min = std::min(min, s->_cursor.load(std::memory_order_acquire));
+        }
+        _min_cursor = min;
+    }
+
+    template <typename U>
+    bool _send(U&& val) {
+        std::lock_guard l(_send_mu);
+        if (_closed.load(std::memory_order_acquire)) return false;
+
+        uint64_t pos = _tail.load(std::memory_order_relaxed);
+        if (_policy == lag_policy::block && pos - _min_cursor > _mask) {
+            auto has_space = [&] {
+                _refresh_min_cursor(pos);
+                return pos - _min_cursor <= _mask || _closed.load(std::memory_order_acquire);
+            };
+            if (!spin_until(has_space, spin_limit, yield_limit)) {
+                _park(_senders_waiting, _space_signal, has_space);
+            }
+            if (_closed.load(std::memory_order_acquire)) return false;
+        }
+
+        _slot& s = _slots[pos & _mask];
+        if (s.seq.load(std::memory_order_relaxed) != 0) {
+            // a lagging subscriber may still be copying the old value out, pairs with the pin in
+            // 'subscriber::_try_read'
+            s.seq.store(_writing);
+            auto unpinned = [&] { return s.readers.load() == 0; };
+            while (!spin_until(unpinned, spin_limit, yield_limit)) {
+            }
+            std::destroy_at(_value(&s));
+        }
+        std::construct_at(_value(&s), std::forward<U>(val));
+        s.seq.store(pos + 1, std::memory_order_release);
+        _tail.store(pos + 1, std::memory_order_release);
+
+        _wake(_receivers_waiting, _data_signal, true);
+        return true;
+    }
+
+    /// sends a value to every current subscriber, returns false if the channel is closed
+    ///
+    /// with 'lag_policy::block' this waits while the slowest subscriber is a full ring behind,
+    /// otherwise it never blocks
+    bool send(const T& val) { return _send(val); }
+
+    /// sends a value to every current subscriber, returns false if the channel is closed
+    bool send(T&& val) { return _send(std::move(val)); }
+
+    /// registers a new subscriber that receives every value sent from now on
+    std::unique_ptr<subscriber> subscribe() { return std::make_unique<subscriber>(this); }
+
+    /// number of live subscribers
+    size_t subscriber_count() {
+        std::lock_guard l(_subs_mu);
+        return _subs.size();
+    }
+
+    /// closes the channel, subscribers still receive the values sent before closing
+    void close() {
+        _closed.store(true, std::memory_order_release);
+        _data_signal.fetch_add(1, std::memory_order_release);
+        _data_signal.notify_all();
+        _space_signal.fetch_add(1, std::memory_order_release);
+        _space_signal.notify_all();
+    }
+
+    /// used to check if the channel is closed
+    bool is_closed() const { return _closed.load(); }
+
+    /// one reader of a 'broadcast_channel', see 'broadcast_channel::subscribe'
+    struct subscriber {
+        broadcast_channel* _ch;
+        alignas(cache_line_size) std::atomic<uint64_t> _cursor;
+        uint64_t _missed = 0;
+
+        explicit subscriber(broadcast_channel* ch) : _ch(ch) {
+            std::lock_guard l(ch->_subs_mu);
+            _cursor.store(ch->_tail.load(std::memory_order_acquire), std::memory_order_relaxed);
+            ch->_subs.push_back(this);
+        }
+
+        ~subscriber() {
+            {
+                std::lock_guard l(_ch->_subs_mu);
+                std::erase(_ch->_subs, this);
+            }
+            // a sender blocked on this subscriber can move on
+            _ch->_wake(_ch->_senders_waiting, _ch->_space_signal, false);
+        }
+
+        subscriber(const subscriber&) = delete;
+        subscriber& operator=(const subscriber&) = delete;
+
+        enum class _read { value, empty, lagged };
+
+        // copies the value at the cursor into 'out', a subscriber that fell more than a ring
+        // behind is moved up to the oldest value still in the ring
+        _read _try_read(std::optional<T>& out) {
+            while (true) {
+                uint64_t cursor = _cursor.load(std::memory_order_relaxed);
+                uint64_t tail = _ch->_tail.load(std::memory_order_acquire);
+                if (cursor == tail) return _read::empty;
+
+                if (tail - cursor > _ch->_mask + 1) {
+                    uint64_t oldest = tail - (_ch->_mask + 1);
+                    _missed += oldest - cursor;
+                    _cursor.store(oldest, std::memory_order_relaxed);
+                    if (_ch->_policy == lag_policy::report) return _read::lagged;
+                    continue;
+                }
+
+                // pinning before checking the sequence keeps the sender from replacing the value
+                // while it is copied, if the sender got there first the value is gone
+                _slot& s = _ch->_slots[cursor & _ch->_mask];
+                s.readers.fetch_add(1);
+                if (s.seq.load() != cursor + 1) {
+                    s.readers.fetch_sub(1, std::memory_order_release);
+                    _missed++;
+                    _cursor.store(cursor + 1, std::memory_order_relaxed);
+                    if (_ch->_policy == lag_policy::report) return _read::lagged;
+                    continue;
+                }
+
+                out.emplace(*_value(&s));
+                s.readers.fetch_sub(1, std::memory_order_release);
+                _cursor.store(cursor + 1, std::memory_order_release);
+
+                if (_ch->_policy == lag_policy::block) {
+                    _wake(_ch->_senders_waiting, _ch->_space_signal, false);
+                }
+                return _read::value;
+            }
+        }
+
+        /// receives the next value, blocking until one is sent, returns an empty optional once the
+        /// channel is closed and every value sent before was received
+        ///
+        /// with 'lag_policy::report' an empty optional is also returned once after falling behind,
+        /// 'take_missed' then returns how many values were lost and the next call resumes from the
+        /// oldest value still in the ring
+        std::optional<T> receive() {
+            std::optional<T> val;
+            _read result = _read::empty;
+            auto ready = [&] {
+                result = _try_read(val);
+                return result != _read::empty || _ch->_closed.load(std::memory_order_acquire);
+            };
+
+            if (!spin_until(ready, spin_limit, yield_limit)) {
+                _park(_ch->_receivers_waiting, _ch->_data_signal, ready);
+            }
+
+            // closed while empty, values sent right before closing may still have landed
+            if (result == _read::empty) _try_read(val);
+            return val;
+        }
+
+        /// receives the next value only if one is available without blocking
+        std::optional<T> try_receive() {
+            std::optional<T> val;
+            _try_read(val);
+            return val;
+        }
+
+        /// returns how many values this subscriber lost to overruns since the last call
+        uint64_t take_missed() { return std::exchange(_missed, 0); }
+
+        /// number of values sent that this subscriber has not received yet, including values that
+        /// were already overwritten
+        size_t pending() const {
+            return size_t(
+                _ch->_tail.load(std::memory_order_acquire) -
+                _cursor.load(std::memory_order_relaxed)
+            );
+        }
+    };
+};
+
+}  // namespace qk::threading
+
+#endif
+
+#endif  // BROADCAST_CHANNEL_H
@@ -0,0 +1,45 @@
+#include "context.h"
+
+#ifdef QK_THREADING
+
+namespace qk::threading {
+
+void context::cancel() const {
+    if (_state) _state->_stop.request_stop();
+}
+
+context_error context::err() const {
+    if (!_state) return context_error::none;
+    if (_state->_stop.stop_requested()) return context_error::cancelled;
+    if (_state->_deadline && std::chrono::steady_clock::now() >= *_state->_deadline) {
+        return context_error::deadline_exceeded;
+    }
+    return context_error::none;
+}
+
+QK_API context with_cancel(const context& parent) {
+    auto state = std::make_shared<_context_state>();
+    if (parent._state) {
+        state->_deadline = parent._state->_deadline;
+        // runs right away if the parent is already cancelled
+        state->_parent_link.emplace(parent._state->_stop.get_token(), _cancel_child{state->_stop});
+    }
+    return {std::move(state)};
+}
+
+QK_API context with_deadline(
+    const context& parent, std::chrono::steady_clock::time_point deadline
+) {
+    context ctx = with_cancel(parent);
+    auto& d = ctx._state->_deadline;
+    if (!d || deadline < *d) d = deadline;
+    return ctx;
+}
+
+QK_API context with_timeout(const context& parent, std::chrono::steady_clock::duration timeout) {
+    return with_deadline(parent, std::chrono::steady_clock::now() + timeout);
+}
+
+}  // namespace qk::threading
+
+#endif
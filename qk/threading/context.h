@@ -0,0 +1,93 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#ifdef QK_THREADING
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include "../api.h"
+
+namespace qk::threading {
+
+/// why a 'context' is done, see 'context::err'
+enum class context_error {
+    none,
+    cancelled,
+    deadline_exceeded,
+};
+
+// requests stop on a child context once its parent is cancelled
+struct _cancel_child {
+    std::stop_source child;
+    void operator()() { child.request_stop(); }
+};
+
+struct QK_API _context_state {
+    std::stop_source _stop;
+    std::optional<std::chrono::steady_clock::time_point> _deadline;
+
+    // unregisters itself from the parent when the child goes away, so long lived parents do not
+    // accumulate callbacks of finished children
+    std::optional<std::stop_callback<_cancel_child>> _parent_link;
+};
+
+/// a go style context, carries cancellation and an optional deadline across goroutines and
+/// channel waits
+///
+/// contexts form a tree, cancelling a context cancels every context derived from it but never its
+/// parent, a default constructed context is the background context which is never done
+///
+/// a context is a cheap handle to shared state, copies refer to the same context
+///
+///     @code
+///     auto ctx = with_cancel();
+///     go(ctx, [&](const context& ctx) {
+///         while (auto chunk = chunks.receive(ctx)) { ... }
+///     });
+///     ...
+///     ctx.cancel();  // wakes only the goroutine above, 'chunks' stays open for everyone else
+///     @endcode
+struct QK_API context {
+    std::shared_ptr<_context_state> _state;
+
+    /// cancels this context and every context derived from it, waking every channel operation
+    /// waiting on them, does nothing on the background context
+    void cancel() const;
+
+    /// returns why the context is done, or 'context_error::none' if it is not
+    context_error err() const;
+
+    /// true once the context was cancelled or its deadline passed
+    bool done() const { return err() != context_error::none; }
+
+    /// the deadline of this context, inherited from the parent if that one is earlier
+    std::optional<std::chrono::steady_clock::time_point> deadline() const {
+        return _state ? _state->_deadline : std::nullopt;
+    }
+
+    /// a token that is triggered when the context is cancelled, deadlines do not trigger it, code
+    /// that blocks on its own should also wait with 'deadline'
+    std::stop_token stop_token() const {
+        return _state ? _state->_stop.get_token() : std::stop_token();
+    }
+};
+
+/// returns the background context, it is never cancelled and has no deadline
+inline context background() { return {}; }
+
+/// returns a child of 'parent' that can be cancelled on its own with 'context::cancel'
+QK_API context with_cancel(const context& parent = {});
+
+/// returns a cancellable child of 'parent' that is done once 'deadline' passes
+QK_API context with_deadline(const context& parent, std::chrono::steady_clock::time_point deadline);
+
+/// returns a cancellable child of 'parent' that is done after 'timeout'
+QK_API context with_timeout(const context& parent, std::chrono::steady_clock::duration timeout);
+
+}  // namespace qk::threading
+
+#endif
+
+#endif  // CONTEXT_H
@@ -0,0 +1,133 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#ifdef QK_THREADING
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <utility>
+#include "../api.h"
+#include "scheduler.h"
+
+namespace qk::threading {
+
+inline std::atomic<size_t> _co_frames = 0;
+inline std::atomic<size_t> _co_frame_bytes = 0;
+
+/// a lightweight goroutine built on c++20 coroutines, many of them are multiplexed onto the few
+/// worker threads of a 'thread_pool'
+///
+/// a coroutine returning 'co_task' does not start until it is spawned with 'go_co', it can then
+/// 'co_await' channel operations like 'async_receive' and 'async_send', which park only the
+/// coroutine and let the worker thread pick up other tasks
+///
+///     @code
+///     co_task entity_script(channel<event>& events) {
+///         while (auto e = co_await events.async_receive()) { ... }
+///     }
+///
+///     go_co(entity_script(events));
+///     @endcode
+///
+/// the coroutine frame is the only allocation, suspending and resuming reuses it as the pool task
+///
+/// @note
+/// blocking calls like 'send', 'receive' or 'sleep_ms' inside a coroutine still block the whole
+/// worker thread, use the async channel operations instead
+struct QK_API co_task {
+    struct promise_type : task {
+        thread_pool* _pool = nullptr;
+
+        promise_type() { _run = &run; }
+
+        static void run(task* t) {
+            std::coroutine_handle<promise_type>::from_promise(*static_cast<promise_type*>(t))
+                .resume();
+        }
+
+        co_task get_return_object() {
+            return co_task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        // the frame frees itself once the coroutine finishes, nothing awaits a 'co_task'
+        std::suspend_never final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+
+        static void* operator new(size_t size) {
+            _co_frames.fetch_add(1, std::memory_order_relaxed);
+            _co_frame_bytes.fetch_add(size, std::memory_order_relaxed);
+            return ::operator new(size);
+        }
+
+        static void operator delete(void* ptr, size_t size) {
+            _co_frames.fetch_sub(1, std::memory_order_relaxed);
+            _co_frame_bytes.fetch_sub(size, std::memory_order_relaxed);
+            ::operator delete(ptr);
+        }
+    };
+
+    std::coroutine_handle<promise_type> _handle;
+
+    explicit co_task(std::coroutine_handle<promise_type> h) : _handle(h) {}
+
+    co_task(co_task&& other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+
+    co_task& operator=(co_task&& other) noexcept {
+        if (this != &other) {
+            if (_handle) _handle.destroy();
+            _handle = std::exchange(other._handle, nullptr);
+        }
+        return *this;
+    }
+
+    co_task(const co_task&) = delete;
+    co_task& operator=(const co_task&) = delete;
+
+    // a task that was never spawned still owns its frame
+    ~co_task() {
+        if (_handle) _handle.destroy();
+    }
+};
+
+/// starts a 'co_task' on 'pool', returns false if the pool is shutting down, in which case the
+/// coroutine is destroyed without running
+///
+/// @note
+/// a coroutine suspended on a channel when its pool shuts down is never resumed and its frame is
+/// leaked, close the channels it waits on before shutting the pool down
+inline bool go_co(co_task t, thread_pool* pool = default_pool()) {
+    auto h = std::exchange(t._handle, nullptr);
+    h.promise()._pool = pool;
+
+    if (!submit(&h.promise(), pool)) {
+        h.destroy();
+        return false;
+    }
+    return true;
+}
+
+/// memory held by live coroutine frames, see 'co_task_footprint'
+struct co_footprint {
+    size_t frames;
+    size_t bytes;
+};
+
+/// returns how many 'co_task' frames are currently alive and how many bytes they take up, useful
+/// for sizing how many coroutines a frame budget can afford
+inline co_footprint co_task_footprint() {
+    return {_co_frames.load(std::memory_order_relaxed),
+            _co_frame_bytes.load(std::memory_order_relaxed)};
+}
+
+}  // namespace qk::threading
+
+#endif
+
+#endif  // COROUTINE_H
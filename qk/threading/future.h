@@ -0,0 +1,445 @@
+#ifndef FUTURE_H
+#define FUTURE_H
+
+#ifdef QK_THREADING
+
+#include <array>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <source_location>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "../api.h"
+#include "gorutines.h"
+#include "scheduler.h"
+
+namespace qk::threading {
+
+// marks a future state whose value was stored, see '_future_base::_cont'
+inline task _future_done;
+
+// the type erased part of a future state, shared by the 'future' and whatever produces its value
+struct QK_API _future_base {
+    // the future and the producer, the state is destroyed once both let go
+    std::atomic<int> _refs = 2;
+
+    // null while pending, '_future_done' once the value is stored, or the continuation waiting
+    // for the value, a future has at most one since 'then' consumes it
+    std::atomic<task*> _cont = nullptr;
+
+    // where continuations run, null runs each of them on a fresh goroutine
+    thread_pool* _pool = nullptr;
+
+    void (*_destroy)(_future_base*) = nullptr;
+
+    void _release() {
+        if (_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) _destroy(this);
+    }
+
+    bool _ready() const { return _cont.load(std::memory_order_acquire) == &_future_done; }
+
+    void _wait() const {
+        task* c;
+        while ((c = _cont.load(std::memory_order_acquire)) != &_future_done) {
+            _cont.wait(c, std::memory_order_acquire);
+        }
+    }
+
+    // publishes the stored value, runs the continuation if one is registered already
+    void _finish() {
+        task* c = _cont.exchange(&_future_done, std::memory_order_acq_rel);
+        if (c)
+            c->_run(c);
+        else
+            _cont.notify_all();
+    }
+
+    // runs 'c' once the value is stored, right away if it already is
+    void _then(task* c) {
+        task* expected = nullptr;
+        if (!_cont.compare_exchange_strong(
+                expected, c, std::memory_order_acq_rel, std::memory_order_acquire
+            )) {
+            c->_run(c);
+        }
+    }
+};
+
+// 'void' futures still store something so every state has the same shape
+template <typename T>
+using _future_value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+template <typename T>
+struct _future_state : _future_base {
+    std::optional<_future_value<T>> _value;
+
+    template <typename... A>
+    void _set(A&&... args) {
+        _value.emplace(std::forward<A>(args)...);
+        _finish();
+    }
+};
+
+// a future state that is also the task computing its value, so starting async work or chaining a
+// continuation is a single allocation and the result is stored inline
+template <typename T, typename Body>
+struct _future_task : _future_state<T>, task {
+    Body body;
+
+    _future_task(Body&& b, thread_pool* pool) : body(std::move(b)) {
+        this->_pool = pool;
+        this->_destroy = &destroy;
+        _run = &dispatch;
+    }
+
+    static void destroy(_future_base* b) { delete static_cast<_future_task*>(b); }
+
+    static void execute(task* t) {
+        auto self = static_cast<_future_task*>(t);
+        if constexpr (std::is_void_v<T>) {
+            self->body();
+            self->_set();
+        } else {
+            self->_set(self->body());
+        }
+        self->_release();
+    }
+
+    // moves the body over to the executor of the future, runs it inline if the pool is shutting
+    // down so the future still completes
+    static void dispatch(task* t) {
+        auto self = static_cast<_future_task*>(t);
+        self->_run = &execute;
+        if (!self->_pool) {
+            _spawn_goroutine([self] { execute(self); }, std::source_location::current());
+        } else if (!submit(self, self->_pool)) {
+            execute(self);
+        }
+    }
+};
+
+template <typename T, typename Fn>
+struct _then_result {
+    using type = std::invoke_result_t<Fn&, T>;
+};
+
+template <typename Fn>
+struct _then_result<void, Fn> {
+    using type = std::invoke_result_t<Fn&>;
+};
+
+/// the result of a function started with 'go_async', lets the caller wait for it or chain more
+/// work onto it without blocking a thread
+///
+///     @code
+///     auto mesh = go_async(load_mesh, path)
+///                     .then([](mesh_data m) { return optimize(std::move(m)); })
+///                     .then([&](mesh_data m) { return upload(gpu, m); });
+///     ...
+///     gpu_handle h = mesh.get();
+///     @endcode
+///
+/// a future is move only and consumed by 'get', 'then' and 'when_all'/'when_any', dropping one
+/// without consuming it is fine, the work still runs to completion like a 'go'
+template <typename T>
+struct QK_API future {
+    _future_state<T>* _state = nullptr;
+
+    future() = default;
+    explicit future(_future_state<T>* state) : _state(state) {}
+
+    future(future&& other) noexcept : _state(std::exchange(other._state, nullptr)) {}
+
+    future& operator=(future&& other) noexcept {
+        if (this != &other) {
+            if (_state) _state->_release();
+            _state = std::exchange(other._state, nullptr);
+        }
+        return *this;
+    }
+
+    future(const future&) = delete;
+    future& operator=(const future&) = delete;
+
+    ~future() {
+        if (_state) _state->_release();
+    }
+
+    /// false for default constructed futures and ones that were already consumed
+    bool valid() const { return _state != nullptr; }
+
+    /// true once the value is available and 'get' would not block
+    bool ready() const { return _state && _state->_ready(); }
+
+    /// blocks until the value is available
+    void wait() const { _state->_wait(); }
+
+    /// blocks until the value is available and moves it out, the future is empty afterwards
+    ///
+    /// @note
+    /// waiting from inside a pool task on a future computed by the same pool can deadlock once
+    /// every worker is waiting, chain the rest of the work with 'then' instead
+    T get() {
+        _state->_wait();
+        auto state = std::exchange(_state, nullptr);
+        if constexpr (std::is_void_v<T>) {
+            state->_release();
+        } else {
+            T val = std::move(*state->_value);
+            state->_release();
+            return val;
+        }
+    }
+
+    /// consumes the future and returns a future of 'fn' applied to its value, 'fn' runs on the
+    /// same executor as the work it follows once the value is available, a fresh goroutine for
+    /// 'go_async' and the same pool for 'go_async_on'
+    template <typename Fn>
+        requires(std::is_void_v<T> ? std::invocable<Fn&> : std::invocable<Fn&, T>)
+    auto then(Fn fn) && {
+        using U = typename _then_result<T, Fn>::type;
+        _future_state<T>* src = std::exchange(_state, nullptr);
+        thread_pool* pool = src->_pool;
+
+        auto body = [src, fn = std::move(fn)]() mutable -> U {
+            if constexpr (std::is_void_v<T>) {
+                src->_release();
+                return fn();
+            } else {
+                T val = std::move(*src->_value);
+                src->_release();
+                return fn(std::move(val));
+            }
+        };
+        auto state = new _future_task<U, decltype(body)>(std::move(body), pool);
+        src->_then(state);
+        return future<U>(state);
+    }
+};
+
+template <typename Body>
+auto _start_future(thread_pool* pool, Body&& body) {
+    using T = std::invoke_result_t<std::decay_t<Body>&>;
+    auto state = new _future_task<T, std::decay_t<Body>>(std::forward<Body>(body), pool);
+    state->_run(state);
+    return future<T>(state);
+}
+
+/// same as 'go' but returns a 'future' of the result of 'func'
+template <typename Func, typename... Args>
+auto go_async(Func&& func, Args&&... args) {
+    return _start_future(
+        nullptr,
+        [func = std::forward<Func>(func), ... args = std::forward<Args>(args)]() mutable {
+            return func(std::forward<Args>(args)...);
+        }
+    );
+}
+
+/// same as 'go_on' but returns a 'future' of the result of 'func', continuations added with
+/// 'then' run on 'pool' too
+template <typename Func, typename... Args>
+auto go_async_on(thread_pool* pool, Func&& func, Args&&... args) {
+    return _start_future(
+        pool,
+        [func = std::forward<Func>(func), ... args = std::forward<Args>(args)]() mutable {
+            return func(std::forward<Args>(args)...);
+        }
+    );
+}
+
+template <typename T>
+struct _when_all_state : _future_state<std::vector<T>> {
+    // registered as the continuation of one input
+    struct _node : task {
+        _when_all_state* owner;
+        _future_state<T>* src;
+        size_t index;
+    };
+
+    std::vector<_node> _nodes;
+    std::vector<std::optional<T>> _results;
+    std::atomic<size_t> _remaining;
+
+    explicit _when_all_state(size_t count) : _nodes(count), _results(count), _remaining(count) {
+        this->_destroy = &destroy;
+    }
+
+    static void destroy(_future_base* b) { delete static_cast<_when_all_state*>(b); }
+
+    // runs on the thread that completed the input, only moves its value over
+    static void arrive(task* t) {
+        auto n = static_cast<_node*>(t);
+        _when_all_state* self = n->owner;
+        self->_results[n->index].emplace(std::move(*n->src->_value));
+        n->src->_release();
+        if (self->_remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+        std::vector<T> all;
+        all.reserve(self->_results.size());
+        for (auto& r : self->_results) {
+            all.push_back(std::move(*r));
+        }
+        self->_set(std::move(all));
+        self->_release();
+    }
+};
+
+/// consumes 'futures' and returns a future of all their values in the same order, it completes
+/// once the last input does, continuations run on the executor of the first input
+template <typename T>
+    requires(!std::is_void_v<T>)
+future<std::vector<T>> when_all(std::vector<future<T>> futures) {
+    auto state = new _when_all_state<T>(futures.size());
+    if (futures.empty()) {
+        state->_set();
+        state->_release();
+        return future<std::vector<T>>(state);
+    }
+
+    state->_pool = futures[0]._state->_pool;
+    for (size_t i = 0; i < futures.size(); i++) {
+        auto& n = state->_nodes[i];
+        n._run = &_when_all_state<T>::arrive;
+        n.owner = state;
+        n.src = std::exchange(futures[i]._state, nullptr);
+        n.index = i;
+    }
+    for (auto& n : state->_nodes) {
+        n.src->_then(&n);
+    }
+    return future<std::vector<T>>(state);
+}
+
+template <typename... Ts>
+struct _when_all_tuple_state : _future_state<std::tuple<Ts...>> {
+    struct _node : task {
+        _when_all_tuple_state* owner;
+        _future_base* src;
+    };
+
+    std::array<_node, sizeof...(Ts)> _nodes{};
+    std::tuple<std::optional<Ts>...> _results;
+    std::atomic<size_t> _remaining = sizeof...(Ts);
+
+    _when_all_tuple_state() { this->_destroy = &destroy; }
+
+    static void destroy(_future_base* b) { delete static_cast<_when_all_tuple_state*>(b); }
+
+    template <size_t I>
+    static void arrive(task* t) {
+        using V = std::tuple_element_t<I, std::tuple<Ts...>>;
+        auto n = static_cast<_node*>(t);
+        _when_all_tuple_state* self = n->owner;
+        auto src = static_cast<_future_state<V>*>(n->src);
+        std::get<I>(self->_results).emplace(std::move(*src->_value));
+        src->_release();
+        if (self->_remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+        self->_set(std::apply(
+            [](auto&... r) { return std::tuple<Ts...>(std::move(*r)...); }, self->_results
+        ));
+        self->_release();
+    }
+};
+
+/// consumes futures of different types and returns a future of a tuple of their values, it
+/// completes once the last input does, continuations run on the executor of the first input
+///
+///     @code
+///     auto [mesh, tex] = when_all(go_async(load_mesh, a), go_async(load_texture, b)).get();
+///     @endcode
+template <typename... Ts>
+    requires(sizeof...(Ts) > 0 && (!std::is_void_v<Ts> && ...))
+future<std::tuple<Ts...>> when_all(future<Ts>... futures) {
+    using state_t = _when_all_tuple_state<Ts...>;
+    auto state = new state_t();
+    std::tuple<future<Ts>&...> inputs(futures...);
+    state->_pool = std::get<0>(inputs)._state->_pool;
+
+    [&]<size_t... I>(std::index_sequence<I...>) {
+        ((state->_nodes[I]._run = &state_t::template arrive<I>,
+          state->_nodes[I].owner = state,
+          state->_nodes[I].src = std::exchange(std::get<I>(inputs)._state, nullptr)),
+         ...);
+    }(std::index_sequence_for<Ts...>{});
+
+    for (auto& n : state->_nodes) {
+        n.src->_then(&n);
+    }
+    return future<std::tuple<Ts...>>(state);
+}
+
+/// the first finished input of 'when_any' and its position
+template <typename T>
+struct when_any_result {
+    size_t index;
+    T value;
+};
+
+template <typename T>
+struct _when_any_state : _future_state<when_any_result<T>> {
+    struct _node : task {
+        _when_any_state* owner;
+        _future_state<T>* src;
+        size_t index;
+    };
+
+    std::vector<_node> _nodes;
+    std::atomic_bool _won = false;
+
+    // every input keeps the state alive until it finished, not just the first one
+    explicit _when_any_state(size_t count) : _nodes(count) {
+        this->_refs = int(count) + 1;
+        this->_destroy = &destroy;
+    }
+
+    static void destroy(_future_base* b) { delete static_cast<_when_any_state*>(b); }
+
+    static void arrive(task* t) {
+        auto n = static_cast<_node*>(t);
+        _when_any_state* self = n->owner;
+        if (!self->_won.exchange(true, std::memory_order_acq_rel)) {
+            self->_set(when_any_result<T>{n->index, std::move(*n->src->_value)});
+        }
+        n->src->_release();
+        self->_release();
+    }
+};
+
+/// consumes 'futures' and returns a future of the first value to become available, the values of
+/// the other inputs are dropped once they finish, continuations run on the executor of the first
+/// input
+///
+/// returns an empty future if 'futures' is empty
+template <typename T>
+    requires(!std::is_void_v<T>)
+future<when_any_result<T>> when_any(std::vector<future<T>> futures) {
+    if (futures.empty()) return {};
+
+    auto state = new _when_any_state<T>(futures.size());
+    state->_pool = futures[0]._state->_pool;
+    for (size_t i = 0; i < futures.size(); i++) {
+        auto& n = state->_nodes[i];
+        n._run = &_when_any_state<T>::arrive;
+        n.owner = state;
+        n.src = std::exchange(futures[i]._state, nullptr);
+        n.index = i;
+    }
+    for (auto& n : state->_nodes) {
+        n.src->_then(&n);
+    }
+    return future<when_any_result<T>>(state);
+}
+
+}  // namespace qk::threading
+
+#endif
+
+#endif  // FUTURE_H
@@ -3,26 +3,123 @@
 
 #ifdef QK_THREADING
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
-#include <condition_variable>
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <memory>
 #include <mutex>
+#include <new>
 #include <optional>
-#include <queue>
+#include <semaphore>
+#include <source_location>
+#include <span>
+#include <stop_token>
 #include <thread>
+#include <utility>
+#include <vector>
 #include "../api.h"
+#include "context.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "sync.h"
 
 /// implements go style threading with focus on simplicity of use
 namespace qk::threading {
 
+// runs 'body' on a detached thread, registering it in the goroutine registry when
+// 'QK_THREADING_STATS' is defined
+template <typename Body>
+void _spawn_goroutine(Body&& body, std::source_location site) {
+#ifdef QK_THREADING_STATS
+    auto g = std::make_unique<_goroutine_record>(site);
+    _track_goroutine(g.get());
+    std::jthread([g = std::move(g), body = std::forward<Body>(body)]() mutable {
+        _current_goroutine() = g.get();
+        g->state = goroutine_state::running;
+        body();
+        _current_goroutine() = nullptr;
+        _untrack_goroutine(g.get());
+    }).detach();
+#else
+    (void)site;
+    std::jthread(std::forward<Body>(body)).detach();
+#endif
+}
+
+/// same as 'go' but records 'site' as the place the goroutine was created, see 'goroutines', for
+/// wrappers that spawn goroutines on behalf of their caller
+template <typename Func, typename... Args>
+    requires(!std::same_as<std::decay_t<Func>, context>)
+void go_at(std::source_location site, Func&& func, Args&&... args) {
+    _spawn_goroutine(
+        [func = std::forward<Func>(func), ... args = std::forward<Args>(args)]() mutable {
+            func(std::forward<Args>(args)...);
+        },
+        site
+    );
+}
+
+/// same as 'go' with a context but records 'site' as the place the goroutine was created
+template <typename Func, typename... Args>
+void go_at(std::source_location site, const context& ctx, Func&& func, Args&&... args) {
+    _spawn_goroutine(
+        [ctx, func = std::forward<Func>(func), ... args = std::forward<Args>(args)]() mutable {
+            if (ctx.done()) return;
+            if constexpr (std::invocable<std::decay_t<Func>&, const context&, Args...>)
+                func(ctx, std::forward<Args>(args)...);
+            else
+                func(std::forward<Args>(args)...);
+        },
+        site
+    );
+}
+
 /// implements a goroutine port from go, unlike in go this uses real threads instead of green
 /// threads, this makes it unsuitable for spawning thousands of tasks, but performs quite well for
 /// simple asynchronous calls
+///
+/// for fanning out many small tasks use 'go_on' with a 'thread_pool' instead, which reuses a fixed
+/// set of workers, for thousands of tasks that wait on channels use a 'co_task' with 'go_co'
+///
+/// the goroutine registry records the caller of 'go(func)', calls that also pass arguments record
+/// 'go' itself, use 'go_at' to name their call site
+template <typename Func>
+    requires(!std::same_as<std::decay_t<Func>, context>)
+void go(Func&& func, std::source_location site = std::source_location::current()) {
+    go_at(site, std::forward<Func>(func));
+}
+
 template <typename Func, typename... Args>
+    requires(!std::same_as<std::decay_t<Func>, context> && sizeof...(Args) > 0)
 void go(Func&& func, Args&&... args) {
-    std::jthread([func = std::forward<Func>(func), ... args = std::forward<Args>(args)]() mutable {
-        func(std::forward<Args>(args)...);
-    }).detach();
+    go_at(std::source_location::current(), std::forward<Func>(func), std::forward<Args>(args)...);
+}
+
+/// same as 'go' but ties the goroutine to 'ctx', 'func' is skipped if 'ctx' is already done by the
+/// time the thread starts, and gets 'ctx' as its first argument if it accepts it so it can pass it
+/// on to the channel operations it blocks in
+///
+///     @code
+///     go(ctx, [&](const context& ctx) {
+///         while (auto job = jobs.receive(ctx)) { ... }
+///     });
+///     @endcode
+template <typename Func>
+void go(
+    const context& ctx, Func&& func, std::source_location site = std::source_location::current()
+) {
+    go_at(site, ctx, std::forward<Func>(func));
+}
+
+template <typename Func, typename... Args>
+    requires(sizeof...(Args) > 0)
+void go(const context& ctx, Func&& func, Args&&... args) {
+    go_at(
+        std::source_location::current(), ctx, std::forward<Func>(func), std::forward<Args>(args)...
+    );
 }
 
 /// sleeps the current thread for the provided amount of milliseconds
@@ -30,12 +127,170 @@ inline void sleep_ms(unsigned int ms) {
     std::this_thread::sleep_for(std::chrono::milliseconds(ms));
 }
 
+/// shared operator and iterator support for the specialised channel types, 'Channel' has to provide
+/// 'send(const T&)', 'send(T&&)' and 'receive()' with the same semantics as 'channel'
+template <typename Channel, typename T>
+struct _channel_ops {
+    Channel& operator<<(const T& val) {
+        static_cast<Channel*>(this)->send(val);
+        return *static_cast<Channel*>(this);
+    }
+
+    Channel& operator<<(T&& val) {
+        static_cast<Channel*>(this)->send(std::move(val));
+        return *static_cast<Channel*>(this);
+    }
+
+    std::optional<T> operator~() { return static_cast<Channel*>(this)->receive(); }
+
+    friend T& operator<<(T& val, Channel& ch) {
+        if (auto opt_val = ch.receive()) {
+            val = std::move(*opt_val);
+        }
+        return val;
+    }
+
+    friend T operator<<(T&& val, Channel& ch) {
+        if (auto opt_val = ch.receive()) {
+            val = std::move(*opt_val);
+        }
+        return std::move(val);
+    }
+
+    struct iterator {
+        Channel* ch;
+        std::optional<T> current;
+        iterator(Channel* c) : ch(c) {
+            if (ch) current = ch->receive();
+            if (!current) ch = nullptr;
+        }
+        iterator() : ch(nullptr) {}
+        T& operator*() { return *current; }
+        T* operator->() { return &(*current); }
+        iterator& operator++() {
+            if (ch) current = ch->receive();
+            if (!current) ch = nullptr;
+            return *this;
+        }
+        bool operator!=(const iterator& other) const { return ch != other.ch; }
+    };
+
+    iterator begin() { return iterator(static_cast<Channel*>(this)); }
+    iterator end() { return iterator(); }
+};
+
+/// shared by the waiters a parked 'select' registers on each of its channels, the first channel
+/// to claim it completes the select and every other registration becomes dead
+struct QK_API _select_claim {
+    static constexpr size_t unclaimed = size_t(-1);
+    std::atomic<size_t> winner = unclaimed;
+
+    // claims the select for case 'index', only succeeds once per select
+    bool claim(size_t index) {
+        size_t expected = unclaimed;
+        return winner.compare_exchange_strong(expected, index, std::memory_order_acq_rel);
+    }
+};
+
+// the semaphore a thread sleeps on while it is parked in a channel, being thread local
+// it outlives every waiter that points at it, so a waker can release it after the waiter is gone
+inline std::binary_semaphore& _thread_parker() {
+    thread_local std::binary_semaphore parker(0);
+    return parker;
+}
+
+/// fifo storage for 'channel', a contiguous ring of raw slots in which values are constructed and
+/// destroyed in place, so traffic through a ring that has reached its size never touches the heap
+///
+/// buffered channels allocate the whole ring up front, unbuffered channels hand every value over
+/// directly and leave it empty, 'push' only grows a ring that was sized too small
+template <typename T>
+struct _ring {
+    struct _slot {
+        alignas(T) std::byte data[sizeof(T)];
+    };
+
+    std::unique_ptr<_slot[]> _slots;
+    size_t _cap = 0;
+    size_t _head = 0;
+    size_t _count = 0;
+
+    explicit _ring(size_t capacity = 0) {
+        if (capacity > 0) _grow(capacity);
+    }
+
+    _ring(_ring&& other) noexcept
+        : _slots(std::move(other._slots)),
+          _cap(std::exchange(other._cap, 0)),
+          _head(std::exchange(other._head, 0)),
+          _count(std::exchange(other._count, 0)) {}
+
+    _ring& operator=(_ring&& other) noexcept {
+        if (this != &other) {
+            clear();
+            _slots = std::move(other._slots);
+            _cap = std::exchange(other._cap, 0);
+            _head = std::exchange(other._head, 0);
+            _count = std::exchange(other._count, 0);
+        }
+        return *this;
+    }
+
+    ~_ring() { clear(); }
+
+    T* _at(size_t i) {
+        size_t index = _head + i;
+        if (index >= _cap) index -= _cap;
+        return std::launder(reinterpret_cast<T*>(_slots[index].data));
+    }
+
+    void _grow(size_t capacity) {
+        auto slots = std::make_unique_for_overwrite<_slot[]>(capacity);
+        for (size_t i = 0; i < _count; i++) {
+            T* old = _at(i);
+            std::construct_at(reinterpret_cast<T*>(slots[i].data), std::move(*old));
+            std::destroy_at(old);
+        }
+        _slots = std::move(slots);
+        _cap = capacity;
+        _head = 0;
+    }
+
+    bool empty() const { return _count == 0; }
+    size_t size() const { return _count; }
+    size_t capacity() const { return _cap; }
+
+    T& front() { return *_at(0); }
+
+    template <typename U>
+    void push(U&& val) {
+        if (_count == _cap) _grow(_cap == 0 ? 1 : _cap * 2);
+        std::construct_at(_at(_count), std::forward<U>(val));
+        _count++;
+    }
+
+    void pop() {
+        std::destroy_at(_at(0));
+        if (++_head == _cap) _head = 0;
+        _count--;
+    }
+
+    void clear() {
+        while (_count > 0) {
+            pop();
+        }
+    }
+};
+
 /// implements a go style channel, all internals are exposed and implementing custom consumers is
 /// encouraged
 ///
 /// this channel implementation can be both buffered and unbuffered, in buffered mode the channel
 /// also has iterator support
 ///
+/// an unbuffered channel is a true rendezvous, whichever side arrives first parks with a slot and
+/// the other side moves the value straight through it and wakes exactly that thread
+///
 /// sending and receiving is done either using methods on the 'channel' type or using the operator
 /// overloads:
 ///
@@ -46,23 +301,116 @@ inline void sleep_ms(unsigned int ms) {
 ///     'auto var = ~ch;' - receives a value from the channel in a way that enables type deduction
 template <typename T>
 struct QK_API channel {
-    std::queue<T> _queue;
+    _ring<T> _queue;
     size_t _capacity = 0;
     std::mutex _mu;
-    std::condition_variable _not_empty, _not_full;
     std::atomic_bool _closed = false;
 
-    std::atomic<int> _senders_waiting = 0;
-    std::atomic<int> _receivers_waiting = 0;
+    // how long blocked senders and receivers poll their parker before sleeping on it
+    spin_budget _spin;
+
+    // mirrors '_queue.size()' so it can be read without the lock
+    std::atomic<size_t> _size = 0;
+
+    // a thread or coroutine parked until a counterpart arrives, for senders '_value' holds the
+    // value to hand over, for receivers it is filled in before the waiter is woken
+    //
+    // every blocking operation parks this way, on a buffered channel senders park once it is full
+    // and receivers once it is empty, so a waker always knows exactly which thread to release
+    //
+    // a 'select' parks one waiter per case, all pointing at the same '_select', a waker has to
+    // claim it before touching '_value', see '_pop_claimed'
+    struct _waiter {
+        std::optional<T> _value;
+        bool _done = false;   // a parked senders value was taken
+        bool _woken = false;  // unlinked by a waker, set under '_mu'
+
+        _select_claim* _select = nullptr;
+        size_t _case = 0;
+
+        // coroutines are resubmitted to their pool, threads are released from their parker
+        task* _task = nullptr;
+        thread_pool* _pool = nullptr;
+        std::binary_semaphore* _parker = nullptr;
+
+        _waiter* _prev = nullptr;
+        _waiter* _next = nullptr;
+    };
+
+    // intrusive fifo of waiters, the nodes live on the waiting threads stack or in the coroutine
+    // frame so parking never allocates
+    struct _waiter_list {
+        _waiter* head = nullptr;
+        _waiter* tail = nullptr;
+        size_t count = 0;
+
+        bool empty() const { return head == nullptr; }
+
+        void push_back(_waiter* w) {
+            w->_prev = tail;
+            w->_next = nullptr;
+            if (tail)
+                tail->_next = w;
+            else
+                head = w;
+            tail = w;
+            count++;
+        }
 
-    channel(size_t capacity = 0) : _capacity(capacity) {}
+        void erase(_waiter* w) {
+            if (w->_prev)
+                w->_prev->_next = w->_next;
+            else
+                head = w->_next;
+            if (w->_next)
+                w->_next->_prev = w->_prev;
+            else
+                tail = w->_prev;
+            count--;
+        }
+
+        _waiter* pop_front() {
+            _waiter* w = head;
+            if (w) erase(w);
+            return w;
+        }
+    };
+
+    _waiter_list _parked_receivers, _parked_senders;
+
+    // runtime counters, an empty struct unless 'QK_THREADING_STATS' is defined
+    [[no_unique_address]] _channel_counters _stats;
+
+    // registered for a thread parked with a 'context', wakes exactly that thread once the context
+    // is cancelled
+    struct _cancel_park {
+        channel* ch;
+        _waiter_list* list;
+        _waiter* w;
+
+        void operator()() const {
+            auto l = ch->_lock();
+            if (w->_woken) return;
+
+            list->erase(w);
+            _wake(w);
+        }
+    };
+
+    /// a buffered channel allocates room for all 'capacity' values up front, sending and receiving
+    /// then never allocates
+    ///
+    /// a blocked sender or receiver first polls its parker for 'spin' before sleeping on it, use
+    /// '{0, 0}' for channels that are usually idle for long stretches
+    channel(size_t capacity = 0, spin_budget spin = {})
+        : _queue(capacity), _capacity(capacity), _spin(spin) {}
 
     channel(channel&& other) noexcept
         : _queue(std::move(other._queue)),
           _capacity(other._capacity),
           _closed(other._closed.load()),
-          _senders_waiting(other._senders_waiting.load()),
-          _receivers_waiting(other._receivers_waiting.load()) {}
+          _spin(other._spin),
+          _size(other._size.load()) {}
 
     channel& operator=(channel&& other) noexcept {
         if (this != &other) {
@@ -70,8 +418,8 @@ struct QK_API channel {
             _queue = std::move(other._queue);
             _capacity = other._capacity;
             _closed = other._closed.load();
-            _senders_waiting = other._senders_waiting.load();
-            _receivers_waiting = other._receivers_waiting.load();
+            _spin = other._spin;
+            _size = other._size.load();
         }
         return *this;
     }
@@ -79,104 +427,457 @@ struct QK_API channel {
     channel(const channel&) = delete;
     channel& operator=(const channel&) = delete;
 
-    /// sends a value through the channel, used by the '<<' send overload
-    bool send(const T& val) {
-        std::unique_lock l(_mu);
-        if (_closed.load()) return false;
+    // takes '_mu', counting contention when instrumentation is enabled
+    std::unique_lock<std::mutex> _lock() { return _stats.lock(_mu); }
+
+    template <typename U>
+    void _push(U&& val) {
+        _queue.push(std::forward<U>(val));
+        _size.store(_queue.size(), std::memory_order_relaxed);
+        _stats.queued(_queue.size());
+    }
 
-        if (_capacity == 0) {
-            ++_senders_waiting;
-            _not_empty.notify_one();
+    T _pop() {
+        T val = std::move(_queue.front());
+        _queue.pop();
+        _size.store(_queue.size(), std::memory_order_relaxed);
+        return val;
+    }
 
-            _not_full.wait(l, [this] { return _closed.load() || _receivers_waiting.load() > 0; });
-            --_senders_waiting;
+    // wakes a waiter that was already unlinked from its list, must be called with '_mu' held
+    static void _wake(_waiter* w) {
+        w->_woken = true;
+        if (w->_task)
+            submit(w->_task, w->_pool);
+        else
+            w->_parker->release();
+    }
 
-            if (_closed.load()) return false;
+    // unlinks the first waiter of 'list' that can still complete, a select that another channel
+    // already claimed is dropped on the way, must be called with '_mu' held
+    _waiter* _pop_claimed(_waiter_list& list) {
+        while (_waiter* w = list.pop_front()) {
+            w->_woken = true;
+            if (!w->_select || w->_select->claim(w->_case)) return w;
+        }
+        return nullptr;
+    }
 
-            _queue.push(val);
-            _not_empty.notify_one();
+    // moves a value straight into the slot of the first parked receiver and wakes exactly that
+    // receiver, queues the value if nobody is parked and a buffered channel has room, returns
+    // false without touching 'val' otherwise, must be called with '_mu' held
+    template <typename U>
+    bool _offer(U&& val) {
+        if (_waiter* w = _pop_claimed(_parked_receivers)) {
+            w->_value.emplace(std::forward<U>(val));
+            _stats.sent();
+            _stats.received();
+            _wake(w);
             return true;
         }
+        if (_queue.size() >= _capacity) return false;
 
-        _not_full.wait(l, [this] { return _closed.load() || _queue.size() < _capacity; });
+        _stats.sent();
+        _push(std::forward<U>(val));
+        return true;
+    }
 
-        if (_closed.load()) return false;
+    // takes the next value, either from the queue or directly from the first parked sender, a slot
+    // freed in a buffered channel is refilled from the first parked sender, must be called with
+    // '_mu' held
+    std::optional<T> _take() {
+        if (_queue.empty()) {
+            _waiter* w = _pop_claimed(_parked_senders);
+            if (!w) return std::nullopt;
+
+            std::optional<T> val(std::move(*w->_value));
+            w->_done = true;
+            _wake(w);
+            _stats.sent();
+            _stats.received();
+            return val;
+        }
 
-        _queue.push(val);
-        _not_empty.notify_one();
+        std::optional<T> val(_pop());
+        _stats.received();
+        if (_capacity > 0) {
+            if (_waiter* w = _pop_claimed(_parked_senders)) {
+                _push(std::move(*w->_value));
+                w->_done = true;
+                _wake(w);
+                _stats.sent();
+            }
+        }
+        return val;
+    }
+
+    // parks the calling thread in 'list' until a counterpart wakes it, 'ctx' is cancelled or
+    // 'deadline' passes, returns false on timeout, expects 'l' to be held and always returns with
+    // it released
+    template <typename Deadline>
+    bool _park(
+        std::unique_lock<std::mutex>& l, _waiter_list& list, _waiter& w, const Deadline* deadline,
+        const context* ctx = nullptr
+    ) {
+        w._parker = &_thread_parker();
+        list.push_back(&w);
+        l.unlock();
+
+        _blocked_scope blocked(_stats, &list == &_parked_senders);
+
+        // registered after unlocking since it runs right away if 'ctx' is already cancelled, its
+        // destructor waits for a running callback, so 'w' outlives every access to it
+        std::optional<std::stop_callback<_cancel_park>> on_cancel;
+        if (ctx && ctx->_state) on_cancel.emplace(ctx->stop_token(), _cancel_park{this, &list, &w});
+
+        if (spin_until([&] { return w._parker->try_acquire(); }, _spin.spins, _spin.yields)) {
+            return true;
+        }
+        if (!deadline) {
+            w._parker->acquire();
+            return true;
+        }
+        if (w._parker->try_acquire_until(*deadline)) return true;
+
+        l.lock();
+        if (!w._woken) {
+            // marked like any other unlink, so a cancellation that fires before 'on_cancel' is
+            // destroyed neither erases 'w' again nor releases the parker
+            w._woken = true;
+            list.erase(&w);
+            l.unlock();
+            return false;
+        }
+        l.unlock();
+
+        // woken right as the deadline passed, the release is on its way and has to be consumed so
+        // the parker stays balanced
+        w._parker->acquire();
         return true;
     }
 
+    template <typename U, typename Deadline>
+    bool _send(U&& val, const Deadline* deadline, const context* ctx = nullptr) {
+        if (ctx && ctx->done()) return false;
+
+        auto l = _lock();
+        if (_closed.load()) return false;
+
+        // a parked receiver (or select) or a free slot takes the value right away, otherwise the
+        // sender parks with the value until a receiver moves it out, a failed offer leaves 'val'
+        // untouched
+        if (_offer(std::forward<U>(val))) return true;
+
+        _waiter w;
+        w._value.emplace(std::forward<U>(val));
+        if (_park(l, _parked_senders, w, deadline, ctx) && w._done) return true;
+
+        // nobody took the value, an rvalue goes back to the caller so a failed send leaves it
+        // where it was
+        if constexpr (!std::is_reference_v<U> && !std::is_const_v<U>) {
+            val = std::move(*w._value);
+        }
+        return false;
+    }
+
+    template <typename Deadline>
+    std::optional<T> _receive(const Deadline* deadline, const context* ctx = nullptr) {
+        if (ctx && ctx->done()) return std::nullopt;
+
+        auto l = _lock();
+        if (std::optional<T> val = _take()) return val;
+        if (_closed.load()) return std::nullopt;
+
+        _waiter w;
+        if (!_park(l, _parked_receivers, w, deadline, ctx)) return std::nullopt;
+
+        // empty if the channel was closed or 'ctx' cancelled while parked
+        return std::move(w._value);
+    }
+
+    using _no_deadline = std::chrono::steady_clock::time_point;
+
     /// sends a value through the channel, used by the '<<' send overload
-    bool send(T&& val) {
-        std::unique_lock l(_mu);
+    bool send(const T& val) { return _send(val, static_cast<const _no_deadline*>(nullptr)); }
+
+    /// sends a value through the channel, used by the '<<' send overload
+    bool send(T&& val) { return _send(std::move(val), static_cast<const _no_deadline*>(nullptr)); }
+
+    /// receives a value from the channel, used by both '<<' and '~' operators
+    std::optional<T> receive() { return _receive(static_cast<const _no_deadline*>(nullptr)); }
+
+    /// same as 'send' but gives up once 'ctx' is done, returns false if it is or the channel is
+    /// closed, cancelling 'ctx' wakes only the operations waiting on it
+    bool send(const T& val, const context& ctx) {
+        auto deadline = ctx.deadline();
+        return _send(val, deadline ? &*deadline : nullptr, &ctx);
+    }
+
+    /// same as 'send' but gives up once 'ctx' is done, returns false if it is or the channel is
+    /// closed, cancelling 'ctx' wakes only the operations waiting on it
+    bool send(T&& val, const context& ctx) {
+        auto deadline = ctx.deadline();
+        return _send(std::move(val), deadline ? &*deadline : nullptr, &ctx);
+    }
+
+    /// same as 'receive' but gives up once 'ctx' is done, an empty result means either a done
+    /// context or a closed channel, use 'context::err' to tell them apart
+    std::optional<T> receive(const context& ctx) {
+        auto deadline = ctx.deadline();
+        return _receive(deadline ? &*deadline : nullptr, &ctx);
+    }
+
+    /// same as 'send' but gives up once 'deadline' passes, returns false on timeout or if the
+    /// channel is closed
+    template <typename Clock, typename Duration>
+    bool send_until(const T& val, const std::chrono::time_point<Clock, Duration>& deadline) {
+        return _send(val, &deadline);
+    }
+
+    /// same as 'send' but gives up once 'deadline' passes, returns false on timeout or if the
+    /// channel is closed, 'val' is only moved from if it was sent
+    template <typename Clock, typename Duration>
+    bool send_until(T&& val, const std::chrono::time_point<Clock, Duration>& deadline) {
+        return _send(std::move(val), &deadline);
+    }
+
+    /// same as 'send' but gives up after 'timeout', returns false on timeout or if the channel is
+    /// closed
+    template <typename Rep, typename Period>
+    bool send_for(const T& val, const std::chrono::duration<Rep, Period>& timeout) {
+        return send_until(val, std::chrono::steady_clock::now() + timeout);
+    }
+
+    /// same as 'send' but gives up after 'timeout', returns false on timeout or if the channel is
+    /// closed, 'val' is only moved from if it was sent
+    template <typename Rep, typename Period>
+    bool send_for(T&& val, const std::chrono::duration<Rep, Period>& timeout) {
+        return send_until(std::move(val), std::chrono::steady_clock::now() + timeout);
+    }
+
+    /// same as 'receive' but gives up once 'deadline' passes, an empty result means either a
+    /// timeout or a closed channel, use 'is_closed' to tell them apart
+    template <typename Clock, typename Duration>
+    std::optional<T> receive_until(const std::chrono::time_point<Clock, Duration>& deadline) {
+        return _receive(&deadline);
+    }
+
+    /// same as 'receive' but gives up after 'timeout', an empty result means either a timeout or
+    /// a closed channel, use 'is_closed' to tell them apart
+    template <typename Rep, typename Period>
+    std::optional<T> receive_for(const std::chrono::duration<Rep, Period>& timeout) {
+        return receive_until(std::chrono::steady_clock::now() + timeout);
+    }
+
+    /// number of values queued in the channel, this is a lock free snapshot that may already be
+    /// outdated when it returns, meant for frame budgeting and diagnostics rather than
+    /// synchronisation
+    size_t size() const { return _size.load(std::memory_order_relaxed); }
+
+    /// lock free snapshot of whether the channel has no queued values, see 'size'
+    bool empty() const { return size() == 0; }
+
+    /// snapshot of the channels runtime counters, all zero unless qk is built with
+    /// 'QK_THREADING_STATS', see 'to_json' for exporting them
+    channel_stats stats() const { return _stats.snapshot(); }
+
+    template <typename U>
+    bool _try_send(U&& val) {
+        auto l = _lock();
         if (_closed.load()) return false;
+        return _offer(std::forward<U>(val));
+    }
 
-        if (_capacity == 0) {
-            ++_senders_waiting;
-            _not_empty.notify_one();
+    /// sends a value only if that is possible without blocking, returns false if the channel is
+    /// full, closed or (when unbuffered) there is no receiver waiting, in which case 'val' is not
+    /// moved from
+    bool try_send(const T& val) { return _try_send(val); }
 
-            _not_full.wait(l, [this] { return _closed.load() || _receivers_waiting.load() > 0; });
+    /// sends a value only if that is possible without blocking, returns false if the channel is
+    /// full, closed or (when unbuffered) there is no receiver waiting, in which case 'val' is not
+    /// moved from
+    bool try_send(T&& val) { return _try_send(std::move(val)); }
 
-            --_senders_waiting;
+    /// receives a value only if one is available without blocking
+    std::optional<T> try_receive() {
+        auto l = _lock();
+        return _take();
+    }
 
-            if (_closed.load()) return false;
+    /// sends a batch of values under a single lock, blocks until at least one value fits and then
+    /// moves as many values from 'vals' as there is space for, returns how many were sent (0 if the
+    /// channel is closed)
+    ///
+    /// every parked receiver is handed its value directly, each woken exactly once for the batch
+    size_t send_n(std::span<T> vals) {
+        if (vals.empty()) return 0;
+
+        auto l = _lock();
+        if (_closed.load()) return 0;
+
+        if (!_offer(std::move(vals[0]))) {
+            // park with the first value like 'send', the rest of the batch goes into whatever
+            // space there is once it was taken
+            _waiter w;
+            w._value.emplace(std::move(vals[0]));
+            if (!_park(l, _parked_senders, w, static_cast<const _no_deadline*>(nullptr)) ||
+                !w._done) {
+                vals[0] = std::move(*w._value);
+                return 0;
+            }
 
-            _queue.push(std::move(val));
-            _not_empty.notify_one();
-            return true;
+            l.lock();
+            if (_closed.load()) return 1;
         }
 
-        _not_full.wait(l, [this] { return _closed.load() || _queue.size() < _capacity; });
+        size_t count = 1;
+        while (count < vals.size() && _offer(std::move(vals[count]))) {
+            count++;
+        }
+        return count;
+    }
 
-        if (_closed.load()) return false;
+    /// receives a batch of values under a single lock, blocks until at least one value is
+    /// available and then moves up to 'max' values into 'out', returns how many were received (0
+    /// once the channel is closed and empty)
+    size_t receive_n(std::span<T> out, size_t max = std::dynamic_extent) {
+        max = std::min(max, out.size());
+        if (max == 0) return 0;
+
+        auto l = _lock();
+        size_t count = 0;
+        if (std::optional<T> val = _take()) {
+            out[count++] = std::move(*val);
+        } else {
+            if (_closed.load()) return 0;
+
+            // park for the first value like 'receive', the rest of the batch is whatever other
+            // senders have queued or parked by the time it arrives
+            _waiter w;
+            _park(l, _parked_receivers, w, static_cast<const _no_deadline*>(nullptr));
+            if (!w._value) return 0;
+
+            out[count++] = std::move(*w._value);
+            l.lock();
+        }
 
-        _queue.push(std::move(val));
-        _not_empty.notify_one();
-        return true;
+        while (count < max) {
+            std::optional<T> val = _take();
+            if (!val) break;
+            out[count++] = std::move(*val);
+        }
+        return count;
     }
 
-    /// receives a value from the channel, used by both '<<' and '~' operators
-    std::optional<T> receive() {
-        std::unique_lock l(_mu);
+    /// moves every value currently queued (and every value offered by a parked sender) into 'out'
+    /// without blocking, returns how many were moved
+    size_t drain(std::vector<T>& out) {
+        auto l = _lock();
+        if (_queue.empty() && _parked_senders.empty()) return 0;
+
+        out.reserve(out.size() + _queue.size() + _parked_senders.count);
+        size_t count = 0;
+        while (std::optional<T> val = _take()) {
+            out.push_back(std::move(*val));
+            count++;
+        }
+        return count;
+    }
 
-        if (_capacity == 0) {
-            ++_receivers_waiting;
-            _not_full.notify_one();
+    // the promise of a coroutine that can park on a channel, it has to be a 'task' so the channel
+    // can resubmit it to its pool without allocating
+    template <typename Promise>
+    static constexpr bool _schedulable_promise =
+        std::derived_from<Promise, task> && requires(Promise& p) {
+            { p._pool } -> std::convertible_to<thread_pool*>;
+        };
 
-            _not_empty.wait(l, [this] {
-                return !_queue.empty() || (_closed.load() && _senders_waiting.load() == 0);
-            });
+    struct _receive_awaiter : _waiter {
+        channel* ch;
 
-            --_receivers_waiting;
+        bool await_ready() const noexcept { return false; }
 
-            if (_queue.empty() && _closed.load()) {
-                return std::nullopt;
-            }
+        template <typename Promise>
+            requires _schedulable_promise<Promise>
+        bool await_suspend(std::coroutine_handle<Promise> h) {
+            auto l = ch->_lock();
+            if ((this->_value = ch->_take())) return false;
+            if (ch->_closed.load()) return false;
 
-            T val = std::move(_queue.front());
-            _queue.pop();
-            return val;
+            this->_task = &h.promise();
+            this->_pool = h.promise()._pool;
+            ch->_parked_receivers.push_back(this);
+            return true;
         }
 
-        _not_empty.wait(l, [this] { return !_queue.empty() || _closed.load(); });
+        std::optional<T> await_resume() { return std::move(this->_value); }
+    };
+
+    struct _send_awaiter : _waiter {
+        channel* ch;
+
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Promise>
+            requires _schedulable_promise<Promise>
+        bool await_suspend(std::coroutine_handle<Promise> h) {
+            auto l = ch->_lock();
+            if (ch->_closed.load()) return false;
 
-        if (_queue.empty() && _closed.load()) {
-            return std::nullopt;
+            if (ch->_offer(std::move(*this->_value))) {
+                this->_done = true;
+                return false;
+            }
+
+            this->_task = &h.promise();
+            this->_pool = h.promise()._pool;
+            ch->_parked_senders.push_back(this);
+            return true;
         }
 
-        T val = std::move(_queue.front());
-        _queue.pop();
-        _not_full.notify_one();
-        return val;
+        bool await_resume() const { return this->_done; }
+    };
+
+    /// receives a value by suspending the calling coroutine instead of blocking its thread, the
+    /// result is empty once the channel is closed and drained
+    ///
+    ///     @code
+    ///     co_task script(channel<event>& events) {
+    ///         while (auto e = co_await events.async_receive()) { ... }
+    ///     }
+    ///     @endcode
+    ///
+    /// only usable from coroutines whose promise is a 'task' scheduled on a 'thread_pool', like
+    /// 'co_task', the coroutine is resumed on that pool
+    _receive_awaiter async_receive() {
+        _receive_awaiter a;
+        a.ch = this;
+        return a;
+    }
+
+    /// sends a value by suspending the calling coroutine instead of blocking its thread, resumes
+    /// with false if the channel is closed before the value was taken
+    _send_awaiter async_send(T val) {
+        _send_awaiter a;
+        a._value.emplace(std::move(val));
+        a.ch = this;
+        return a;
     }
 
     /// closes the channel making it inactive
     void close() {
-        std::lock_guard l(_mu);
+        auto l = _lock();
         _closed = true;
-        _not_empty.notify_all();
-        _not_full.notify_all();
+
+        // a select receiving here completes with an empty value, one sending here is only
+        // unlinked and keeps waiting on its other cases
+        while (_waiter* w = _pop_claimed(_parked_receivers)) {
+            _wake(w);
+        }
+        while (_waiter* w = _parked_senders.pop_front()) {
+            w->_woken = true;
+            if (!w->_select) _wake(w);
+        }
     }
 
     /// used to check if the channel is closed to know if a value can be sent or recieved from it
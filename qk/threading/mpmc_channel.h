@@ -0,0 +1,211 @@
+#ifndef MPMC_CHANNEL_H
+#define MPMC_CHANNEL_H
+
+#ifdef QK_THREADING
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include "../api.h"
+#include "gorutines.h"
+#include "sync.h"
+
+namespace qk::threading {
+
+/// a bounded lock free channel for any number of senders and receivers, based on dmitry vyukovs
+/// sequence numbered ring of cells
+///
+/// every cell carries a sequence number that tells senders and receivers whose turn it is, so the
+/// only shared writes are one compare and swap on the enqueue or dequeue position, threads only
+/// block (on an atomic wait) when the ring is actually full or empty
+///
+/// it keeps the '<<', '~', iterator, 'receive' and 'is_closed' semantics of 'channel', the capacity
+/// is rounded up to a power of two and is at least 2, there is no unbuffered mode
+///
+/// like in go, sending while another thread closes the channel is a race, such a value may be
+/// dropped instead of delivered
+template <typename T>
+struct QK_API mpmc_channel : _channel_ops<mpmc_channel<T>, T> {
+    static constexpr int spin_limit = 64;
+    static constexpr int yield_limit = 16;
+
+    struct _cell {
+        std::atomic<size_t> seq;
+        alignas(T) std::byte data[sizeof(T)];
+    };
+
+    std::unique_ptr<_cell[]> _cells;
+    size_t _mask = 0;
+    std::atomic_bool _closed = false;
+
+    alignas(cache_line_size) std::atomic<size_t> _enqueue_pos = 0;
+    alignas(cache_line_size) std::atomic<size_t> _dequeue_pos = 0;
+
+    alignas(cache_line_size) std::atomic<int> _receivers_waiting = 0;
+    std::atomic<uint32_t> _data_signal = 0;
+    alignas(cache_line_size) std::atomic<int> _senders_waiting = 0;
+    std::atomic<uint32_t> _space_signal = 0;
+
+    mpmc_channel(size_t capacity = 2) {
+        size_t size = std::bit_ceil(std::max<size_t>(capacity, 2));
+        _cells = std::make_unique<_cell[]>(size);
+        _mask = size - 1;
+        for (size_t i = 0; i < size; i++) {
+            _cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~mpmc_channel() {
+        while (_try_pop()) {
+        }
+    }
+
+    mpmc_channel(const mpmc_channel&) = delete;
+    mpmc_channel& operator=(const mpmc_channel&) = delete;
+
+    static T* _value(_cell* cell) { return std::launder(reinterpret_cast<T*>(cell->data)); }
+
+    size_t capacity() const { return _mask + 1; }
+
+    static void _wake_one(std::atomic<int>& waiting, std::atomic<uint32_t>& signal) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) == 0) return;
+        signal.fetch_add(1, std::memory_order_release);
+        signal.notify_one();
+    }
+
+    template <typename U>
+    bool _try_push(U&& val) {
+        size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+        _cell* cell;
+        while (true) {
+            cell = &_cells[pos & _mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+            if (diff == 0) {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;  // full
+            } else {
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        std::construct_at(_value(cell), std::forward<U>(val));
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::optional<T> _try_pop() {
+        size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+        _cell* cell;
+        while (true) {
+            cell = &_cells[pos & _mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+
+            if (diff == 0) {
+                if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return std::nullopt;  // empty
+            } else {
+                pos = _dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        T* slot = _value(cell);
+        std::optional<T> val(std::move(*slot));
+        std::destroy_at(slot);
+        cell->seq.store(pos + _mask + 1, std::memory_order_release);
+        return val;
+    }
+
+    // registers as a waiter and parks until 'attempt' succeeds or the channel closes, 'attempt' is
+    // retried after registering so a wake up can not be missed
+    template <typename Attempt>
+    bool _park(std::atomic<int>& waiting, std::atomic<uint32_t>& signal, Attempt&& attempt) {
+        while (true) {
+            uint32_t seen = signal.load(std::memory_order_acquire);
+            waiting.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            bool done = attempt();
+            if (done || _closed.load(std::memory_order_acquire)) {
+                waiting.fetch_sub(1);
+                return done;
+            }
+
+            signal.wait(seen, std::memory_order_acquire);
+            waiting.fetch_sub(1);
+        }
+    }
+
+    template <typename U>
+    bool _send(U&& val) {
+        if (_closed.load(std::memory_order_acquire)) return false;
+
+        bool sent = false;
+        auto attempt = [&] { return sent = _try_push(std::forward<U>(val)); };
+        auto closed = [&] { return _closed.load(std::memory_order_acquire); };
+
+        spin_until([&] { return attempt() || closed(); }, spin_limit, yield_limit);
+        if (!sent && (closed() || !_park(_senders_waiting, _space_signal, attempt))) return false;
+
+        _wake_one(_receivers_waiting, _data_signal);
+        return true;
+    }
+
+    /// sends a value through the channel, used by the '<<' send overload
+    bool send(const T& val) { return _send(val); }
+
+    /// sends a value through the channel, used by the '<<' send overload
+    bool send(T&& val) { return _send(std::move(val)); }
+
+    /// receives a value from the channel, used by both '<<' and '~' operators
+    std::optional<T> receive() {
+        std::optional<T> val;
+        auto attempt = [&] {
+            val = _try_pop();
+            return val.has_value();
+        };
+        auto closed = [&] { return _closed.load(std::memory_order_acquire); };
+
+        if (!spin_until([&] { return attempt() || closed(); }, spin_limit, yield_limit)) {
+            _park(_receivers_waiting, _data_signal, attempt);
+        } else if (!val) {
+            // closed, drain whatever was sent before closing
+            attempt();
+        }
+
+        if (val) _wake_one(_senders_waiting, _space_signal);
+        return val;
+    }
+
+    /// closes the channel, values already sent can still be received
+    void close() {
+        _closed.store(true, std::memory_order_release);
+        _data_signal.fetch_add(1, std::memory_order_release);
+        _data_signal.notify_all();
+        _space_signal.fetch_add(1, std::memory_order_release);
+        _space_signal.notify_all();
+    }
+
+    /// used to check if the channel is closed to know if a value can be sent or recieved from it
+    bool is_closed() const { return _closed.load(); }
+};
+
+}  // namespace qk::threading
+
+#endif
+
+#endif  // MPMC_CHANNEL_H
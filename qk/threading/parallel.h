@@ -0,0 +1,309 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#ifdef QK_THREADING
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <stop_token>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "../api.h"
+#include "scheduler.h"
+#include "sync.h"
+
+namespace qk::threading {
+
+/// a go style wait group, counts outstanding work and lets a thread block until all of it is done
+///
+///     @code
+///     wait_group wg;
+///     for (auto& asset : assets) {
+///         wg.go([&asset] { decode(asset); });
+///     }
+///     wg.wait();
+///     @endcode
+///
+/// @note
+/// waiting from inside a pool task on work queued to the same pool can deadlock once every worker
+/// is waiting, 'parallel_for' avoids this by running chunks on the calling thread as well
+struct QK_API wait_group {
+    std::mutex _mu;
+    std::condition_variable _zero;
+    int64_t _count = 0;
+
+    wait_group() = default;
+    wait_group(const wait_group&) = delete;
+    wait_group& operator=(const wait_group&) = delete;
+
+    /// adds 'n' units of outstanding work, has to happen before the matching 'done' calls
+    void add(int64_t n = 1) {
+        std::lock_guard l(_mu);
+        _count += n;
+        if (_count == 0) _zero.notify_all();
+    }
+
+    /// marks one unit of work as finished
+    void done() {
+        // notifying under the lock keeps the group alive until the waiter can observe the count,
+        // so it is safe for the waiter to destroy the group as soon as 'wait' returns
+        std::lock_guard l(_mu);
+        if (--_count == 0) _zero.notify_all();
+    }
+
+    /// blocks until every added unit of work is done
+    void wait() {
+        std::unique_lock l(_mu);
+        _zero.wait(l, [this] { return _count == 0; });
+    }
+
+    /// adds one unit of work and runs 'func' on 'pool', marking it done once 'func' returns,
+    /// returns false if the pool is shutting down, in which case 'func' never runs
+    template <typename Func>
+    bool go(Func&& func, thread_pool* pool = default_pool()) {
+        add(1);
+        bool ok = go_on(pool, [this, func = std::forward<Func>(func)]() mutable {
+            func();
+            done();
+        });
+        if (!ok) done();
+        return ok;
+    }
+};
+
+// the shape of 'qk::utils::Result', matched structurally so the threading module does not depend
+// on the utils module
+template <typename R, typename ERR>
+concept _error_result = requires(R r) {
+    { r.err() } -> std::convertible_to<bool>;
+    { std::move(r).unwrap_err() } -> std::convertible_to<ERR>;
+};
+
+/// a go style errgroup, runs functions returning a 'qk::utils::Result<OK, ERR>' on a pool and keeps
+/// the first error
+///
+/// once any function fails the group is cancelled, functions that have not started yet are skipped
+/// and running ones can poll the 'std::stop_token' they get passed if they accept one
+///
+///     @code
+///     error_group<std::string> g;
+///     for (auto& path : paths) {
+///         g.go([&path](std::stop_token stop) -> Result<int, std::string> {
+///             return load(path, stop);
+///         });
+///     }
+///     if (auto e = g.wait()) log_error(*e);
+///     @endcode
+template <typename ERR>
+struct QK_API error_group {
+    thread_pool* _pool;
+    wait_group _wg;
+    std::stop_source _stop;
+    std::mutex _mu;
+    std::optional<ERR> _err;
+
+    explicit error_group(thread_pool* pool = default_pool()) : _pool(pool) {}
+
+    error_group(const error_group&) = delete;
+    error_group& operator=(const error_group&) = delete;
+
+    void _fail(ERR&& err) {
+        {
+            std::lock_guard l(_mu);
+            if (_err) return;
+            _err.emplace(std::move(err));
+        }
+        _stop.request_stop();
+    }
+
+    /// runs 'func' on the groups pool, 'func' may take a 'std::stop_token' that is triggered once
+    /// another function of the group failed, returns false if the pool is shutting down
+    template <typename Func>
+    bool go(Func&& func) {
+        using F = std::decay_t<Func>;
+        constexpr bool takes_token = std::invocable<F&, std::stop_token>;
+        using R = std::conditional_t<
+            takes_token, std::invoke_result<F&, std::stop_token>, std::invoke_result<F&>>::type;
+        static_assert(
+            _error_result<R, ERR>, "error_group functions must return a Result of the groups error"
+        );
+
+        return _wg.go(
+            [this, func = std::forward<Func>(func)]() mutable {
+                if (_stop.stop_requested()) return;
+
+                R result = [&] {
+                    if constexpr (takes_token)
+                        return func(_stop.get_token());
+                    else
+                        return func();
+                }();
+                if (result.err()) _fail(ERR(std::move(result).unwrap_err()));
+            },
+            _pool
+        );
+    }
+
+    /// cancels every function that did not start yet and signals the stop token of running ones
+    void cancel() { _stop.request_stop(); }
+
+    /// the token passed to the groups functions
+    std::stop_token stop_token() const { return _stop.get_token(); }
+
+    /// blocks until every function finished or was skipped, returns the first error if any
+    std::optional<ERR> wait() {
+        _wg.wait();
+        std::lock_guard l(_mu);
+        return std::move(_err);
+    }
+};
+
+// shared between the caller of a parallel loop and its helper tasks, helpers that start after all
+// chunks were claimed only touch the counters, so the loop body can live on the callers stack
+template <typename Body>
+struct _loop_state {
+    Body* body;
+    size_t chunks;
+    alignas(cache_line_size) std::atomic<size_t> next = 0;
+    alignas(cache_line_size) std::atomic<size_t> finished = 0;
+
+    _loop_state(Body* b, size_t c) : body(b), chunks(c) {}
+
+    void run() {
+        size_t ran = 0;
+        for (size_t c; (c = next.fetch_add(1, std::memory_order_relaxed)) < chunks;) {
+            (*body)(c);
+            ran++;
+        }
+        if (ran > 0 && finished.fetch_add(ran, std::memory_order_acq_rel) + ran == chunks) {
+            finished.notify_all();
+        }
+    }
+
+    void wait() {
+        auto all_done = [this] { return finished.load(std::memory_order_acquire) == chunks; };
+        if (spin_until(all_done, 64, 16)) return;
+
+        while (true) {
+            size_t seen = finished.load(std::memory_order_acquire);
+            if (seen == chunks) return;
+            finished.wait(seen, std::memory_order_acquire);
+        }
+    }
+};
+
+// picks a grain of roughly four chunks per worker when none is given
+inline size_t _auto_grain(size_t size, thread_pool* pool) {
+    return std::max<size_t>(1, size / (worker_count(pool) * 4));
+}
+
+// runs 'body(chunk)' for every chunk in [0, chunks), the calling thread works through chunks too,
+// so this never deadlocks when called from inside a pool task
+template <typename Body>
+void _run_chunks(size_t chunks, Body& body, thread_pool* pool) {
+    if (chunks == 0) return;
+    if (chunks == 1) {
+        body(size_t(0));
+        return;
+    }
+
+    auto state = std::make_shared<_loop_state<Body>>(&body, chunks);
+    size_t helpers = std::min(worker_count(pool), chunks - 1);
+    for (size_t i = 0; i < helpers; i++) {
+        if (!go_on(pool, [state] { state->run(); })) break;
+    }
+
+    state->run();
+    state->wait();
+}
+
+/// calls 'fn' for every element of 'range' spread across the workers of 'pool', blocks until all
+/// calls returned
+///
+/// the range is split into chunks of 'grain' elements which are claimed dynamically, so uneven
+/// work balances out, a 'grain' of 0 picks about four chunks per worker, for index loops pass
+/// 'std::views::iota'
+///
+///     @code
+///     parallel_for(std::views::iota(size_t(0), bodies.size()), 64, [&](size_t i) { ... });
+///     parallel_for(assets, 1, [](asset& a) { decode(a); });
+///     @endcode
+template <std::ranges::random_access_range Range, typename Func>
+    requires std::ranges::sized_range<Range>
+void parallel_for(Range&& range, size_t grain, Func&& fn, thread_pool* pool = default_pool()) {
+    size_t size = std::ranges::size(range);
+    if (grain == 0) grain = _auto_grain(size, pool);
+    size_t chunks = (size + grain - 1) / grain;
+
+    auto first = std::ranges::begin(range);
+    auto body = [&](size_t chunk) {
+        size_t lo = chunk * grain;
+        size_t hi = std::min(size, lo + grain);
+        for (size_t i = lo; i < hi; i++) {
+            std::invoke(fn, first[std::ranges::range_difference_t<Range>(i)]);
+        }
+    };
+    _run_chunks(chunks, body, pool);
+}
+
+/// maps every element of 'range' with 'fn' and folds the results with 'reduce', spread across the
+/// workers of 'pool'
+///
+/// each chunk folds its elements starting from its first one, the chunk results are then folded in
+/// order into 'init' on the calling thread, so 'init' is used exactly once like in
+/// 'std::accumulate' and is returned for an empty range, 'reduce' has to be associative, it does
+/// not have to be commutative
+///
+///     @code
+///     float mass = parallel_reduce(bodies, 0, 0.0f, [](const body& b) { return b.mass; });
+///     @endcode
+template <
+    std::ranges::random_access_range Range, typename T, typename Func,
+    typename Reduce = std::plus<>>
+    requires std::ranges::sized_range<Range>
+T parallel_reduce(
+    Range&& range, size_t grain, T init, Func&& fn, Reduce&& reduce = {},
+    thread_pool* pool = default_pool()
+) {
+    size_t size = std::ranges::size(range);
+    if (grain == 0) grain = _auto_grain(size, pool);
+    size_t chunks = (size + grain - 1) / grain;
+
+    std::vector<std::optional<T>> partials(chunks);
+    auto first = std::ranges::begin(range);
+    auto body = [&](size_t chunk) {
+        size_t lo = chunk * grain;
+        size_t hi = std::min(size, lo + grain);
+        T acc(std::invoke(fn, first[std::ranges::range_difference_t<Range>(lo)]));
+        for (size_t i = lo + 1; i < hi; i++) {
+            acc = std::invoke(
+                reduce, std::move(acc),
+                std::invoke(fn, first[std::ranges::range_difference_t<Range>(i)])
+            );
+        }
+        partials[chunk].emplace(std::move(acc));
+    };
+    _run_chunks(chunks, body, pool);
+
+    T result = std::move(init);
+    for (auto& p : partials) {
+        result = std::invoke(reduce, std::move(result), std::move(*p));
+    }
+    return result;
+}
+
+}  // namespace qk::threading
+
+#endif
+
+#endif  // PARALLEL_H
@@ -0,0 +1,371 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#ifdef QK_THREADING
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "../api.h"
+#include "gorutines.h"
+#include "parallel.h"
+
+namespace qk::threading {
+
+/// numbers of one step of a finished 'pipeline', see 'pipeline_report'
+struct stage_stats {
+    size_t workers = 0;
+
+    // values the step took in, for the source the values it produced
+    uint64_t items = 0;
+
+    // time spent inside the step function, summed over every worker, time blocked on the
+    // channels around the step is not counted
+    std::chrono::nanoseconds busy{0};
+
+    // from the start of the pipeline until the last worker of the step finished
+    std::chrono::nanoseconds elapsed{0};
+
+    // capacity of the channel feeding the step, 0 for the source
+    size_t capacity = 0;
+
+    // values waiting in the channel feeding the step, sampled every time a worker went to take one
+    double queue_avg = 0;
+    size_t queue_max = 0;
+
+    /// items handled per second
+    double throughput() const {
+        auto seconds = std::chrono::duration<double>(elapsed).count();
+        return seconds > 0 ? double(items) / seconds : 0;
+    }
+
+    /// fraction of the workers time spent doing actual work, 1 means every worker was busy for
+    /// the whole run
+    double utilization() const {
+        auto available = double(elapsed.count()) * double(workers);
+        return available > 0 ? double(busy.count()) / available : 0;
+    }
+};
+
+/// what 'pipeline::sink' returns once every value went through the pipeline
+///
+/// the bottleneck is usually the step with the highest utilization, with a full channel in front
+/// of it and mostly empty channels behind it, adding workers to any other step does not help
+struct pipeline_report {
+    // the source first and the sink last
+    std::vector<stage_stats> stages;
+    std::chrono::nanoseconds elapsed{0};
+
+    /// index of the step with the highest utilization
+    size_t bottleneck() const {
+        auto it = std::ranges::max_element(stages, {}, &stage_stats::utilization);
+        return size_t(it - stages.begin());
+    }
+};
+
+// what a single worker counted, folded into its step once it finishes so the hot loop never
+// touches shared counters
+struct _stage_tally {
+    uint64_t items = 0;
+    std::chrono::steady_clock::duration busy{0};
+    uint64_t queue_sum = 0;
+    uint64_t queue_samples = 0;
+    size_t queue_max = 0;
+
+    // receives the next input, sampling how many values were waiting for it
+    template <typename T>
+    std::optional<T> take(channel<T>& in) {
+        size_t queued = in.size();
+        queue_sum += queued;
+        queue_samples++;
+        queue_max = std::max(queue_max, queued);
+
+        std::optional<T> val = in.receive();
+        if (val) items++;
+        return val;
+    }
+
+    void worked(std::chrono::steady_clock::time_point since) {
+        busy += std::chrono::steady_clock::now() - since;
+    }
+};
+
+struct _stage_counters {
+    size_t workers;
+    size_t capacity;
+
+    std::mutex mu;
+    size_t live = 0;
+    _stage_tally total;
+    std::chrono::steady_clock::time_point finished{};
+
+    _stage_counters(size_t w, size_t c) : workers(w), capacity(c) {}
+
+    // folds in a finished worker, returns true for the last worker of the step
+    bool leave(const _stage_tally& t) {
+        std::lock_guard l(mu);
+        total.items += t.items;
+        total.busy += t.busy;
+        total.queue_sum += t.queue_sum;
+        total.queue_samples += t.queue_samples;
+        total.queue_max = std::max(total.queue_max, t.queue_max);
+
+        if (--live > 0) return false;
+        finished = std::chrono::steady_clock::now();
+        return true;
+    }
+};
+
+// owns the steps of a pipeline while it is built, nothing runs until 'run'
+struct _pipeline_state {
+    size_t capacity;
+    std::vector<std::unique_ptr<_stage_counters>> stages;
+
+    // spawns the workers of one step, they own the step function and its channels
+    std::vector<std::function<void(wait_group&)>> launch;
+
+    explicit _pipeline_state(size_t c) : capacity(c) {}
+
+    _stage_counters* add(size_t workers, size_t in_capacity) {
+        workers = std::max<size_t>(workers, 1);
+        stages.push_back(std::make_unique<_stage_counters>(workers, in_capacity));
+        return stages.back().get();
+    }
+
+    // starts the workers of a step, 'body' runs the loop of one worker and 'finish' runs once after
+    // the last worker is done, the workers only capture raw pointers so everything they use is
+    // destroyed by the thread that called 'run'
+    template <typename Body, typename Finish>
+    static void spawn(_stage_counters* c, wait_group& wg, Body body, Finish finish) {
+        c->live = c->workers;
+        wg.add(int64_t(c->workers));
+        for (size_t i = 0; i < c->workers; i++) {
+            go([c, &wg, body, finish]() mutable {
+                _stage_tally t;
+                body(t);
+                if (c->leave(t)) finish();
+                wg.done();
+            });
+        }
+    }
+
+    pipeline_report run() {
+        auto start = std::chrono::steady_clock::now();
+        {
+            wait_group wg;
+            for (auto& l : launch) {
+                l(wg);
+            }
+            wg.wait();
+        }
+
+        pipeline_report report;
+        report.elapsed = std::chrono::steady_clock::now() - start;
+        for (auto& c : stages) {
+            const _stage_tally& t = c->total;
+            report.stages.push_back({
+                c->workers,
+                t.items,
+                t.busy,
+                c->finished - start,
+                c->capacity,
+                t.queue_samples > 0 ? double(t.queue_sum) / double(t.queue_samples) : 0,
+                t.queue_max,
+            });
+        }
+        return report;
+    }
+};
+
+template <typename R>
+struct _stage_output {
+    using type = R;
+    static constexpr bool filters = false;
+};
+
+// steps returning an optional drop the values they return empty
+template <typename R>
+struct _stage_output<std::optional<R>> {
+    using type = R;
+    static constexpr bool filters = true;
+};
+
+template <typename Source>
+concept _pipeline_generator = std::invocable<Source&> && requires(Source& src) {
+    typename std::invoke_result_t<Source&>::value_type;
+    { bool(src()) };
+};
+
+template <typename Source>
+concept _pipeline_source =
+    _pipeline_generator<std::decay_t<Source>> || std::ranges::input_range<Source>;
+
+/// a declarative chain of goroutines connected by bounded channels, built from a source, any
+/// number of steps and a sink
+///
+///     @code
+///     auto report = pipeline(paths)
+///                       .stage(decode, 4)
+///                       .stage(transform, 2)
+///                       .sink(upload);
+///     auto& slow = report.stages[report.bottleneck()];
+///     @endcode
+///
+/// the source is either a range, whose elements are sent in order, or a function returning an
+/// optional that is called until it returns an empty one, a step maps each value to a new one and
+/// drops it if it returns an empty optional
+///
+/// 'stage' and 'sink' take the number of goroutines running the step, they all share one copy of
+/// the step function so it has to be safe to call concurrently, with more than one worker values
+/// can leave a step in a different order than they came in
+///
+/// nothing runs until 'sink' is called, which then blocks until the source is exhausted and every
+/// value went through, each channel is closed once every worker of the step in front of it
+/// finished, an lvalue range source is only referenced, so it has to outlive the 'sink' call,
+/// while an rvalue range is moved into the pipeline and owned by it
+template <typename T>
+struct QK_API pipeline {
+    std::unique_ptr<_pipeline_state> _state;
+    std::shared_ptr<channel<T>> _out;
+
+    pipeline(std::unique_ptr<_pipeline_state> state, std::shared_ptr<channel<T>> out)
+        : _state(std::move(state)), _out(std::move(out)) {}
+
+    /// starts a pipeline from 'src', every channel between two steps holds up to 'capacity'
+    /// values
+    template <typename Source>
+        requires _pipeline_source<Source>
+    explicit pipeline(Source&& src, size_t capacity = 64)
+        : _state(std::make_unique<_pipeline_state>(capacity)),
+          _out(std::make_shared<channel<T>>(capacity)) {
+        _stage_counters* c = _state->add(1, 0);
+
+        if constexpr (_pipeline_generator<std::decay_t<Source>>) {
+            auto gen = std::make_shared<std::decay_t<Source>>(std::forward<Source>(src));
+            _state->launch.push_back([c, gen, out = _out](wait_group& wg) {
+                _pipeline_state::spawn(
+                    c, wg,
+                    [gen = gen.get(), out = out.get()](_stage_tally& t) {
+                        auto start = std::chrono::steady_clock::now();
+                        while (auto val = (*gen)()) {
+                            t.worked(start);
+                            t.items++;
+                            out->send(T(std::move(*val)));
+                            start = std::chrono::steady_clock::now();
+                        }
+                    },
+                    [out = out.get()] { out->close(); }
+                );
+            });
+        } else {
+            constexpr bool owned = !std::is_lvalue_reference_v<Source>;
+            using view = std::views::all_t<Source>;
+            auto range = std::make_shared<view>(std::views::all(std::forward<Source>(src)));
+            _state->launch.push_back([c, range, out = _out](wait_group& wg) {
+                _pipeline_state::spawn(
+                    c, wg,
+                    [range = range.get(), out = out.get()](_stage_tally& t) {
+                        auto start = std::chrono::steady_clock::now();
+                        for (auto&& val : *range) {
+                            t.worked(start);
+                            t.items++;
+                            if constexpr (owned)
+                                out->send(T(std::move(val)));
+                            else
+                                out->send(T(val));
+                            start = std::chrono::steady_clock::now();
+                        }
+                    },
+                    [out = out.get()] { out->close(); }
+                );
+            });
+        }
+    }
+
+    pipeline(pipeline&&) = default;
+    pipeline& operator=(pipeline&&) = default;
+
+    /// adds a step running 'fn' on 'workers' goroutines, 'fn' takes a 'T' and returns the value
+    /// passed on, or an optional of it to drop values
+    template <typename Fn>
+        requires std::invocable<Fn&, T>
+    auto stage(Fn fn, size_t workers = 1) && {
+        using R = std::invoke_result_t<Fn&, T>;
+        using U = typename _stage_output<R>::type;
+        static_assert(!std::is_void_v<R>, "the last step of a pipeline is added with 'sink'");
+
+        auto out = std::make_shared<channel<U>>(_state->capacity);
+        _stage_counters* c = _state->add(workers, _state->capacity);
+        auto shared_fn = std::make_shared<Fn>(std::move(fn));
+
+        _state->launch.push_back([c, shared_fn, in = _out, out](wait_group& wg) {
+            _pipeline_state::spawn(
+                c, wg,
+                [fn = shared_fn.get(), in = in.get(), out = out.get()](_stage_tally& t) {
+                    while (auto val = t.take(*in)) {
+                        auto start = std::chrono::steady_clock::now();
+                        R result = (*fn)(std::move(*val));
+                        t.worked(start);
+
+                        if constexpr (_stage_output<R>::filters) {
+                            if (result) out->send(std::move(*result));
+                        } else {
+                            out->send(std::move(result));
+                        }
+                    }
+                },
+                [out = out.get()] { out->close(); }
+            );
+        });
+        return pipeline<U>(std::move(_state), std::move(out));
+    }
+
+    /// adds the last step running 'fn' on 'workers' goroutines, then runs the whole pipeline and
+    /// blocks until every value went through
+    template <typename Fn>
+        requires std::invocable<Fn&, T>
+    pipeline_report sink(Fn fn, size_t workers = 1) && {
+        _stage_counters* c = _state->add(workers, _state->capacity);
+        auto shared_fn = std::make_shared<Fn>(std::move(fn));
+
+        _state->launch.push_back([c, shared_fn, in = _out](wait_group& wg) {
+            _pipeline_state::spawn(
+                c, wg,
+                [fn = shared_fn.get(), in = in.get()](_stage_tally& t) {
+                    while (auto val = t.take(*in)) {
+                        auto start = std::chrono::steady_clock::now();
+                        (*fn)(std::move(*val));
+                        t.worked(start);
+                    }
+                },
+                [] {}
+            );
+        });
+        return _state->run();
+    }
+};
+
+template <typename Source>
+    requires _pipeline_generator<std::decay_t<Source>>
+pipeline(Source&&, size_t = 64)
+    -> pipeline<typename std::invoke_result_t<std::decay_t<Source>&>::value_type>;
+
+template <typename Source>
+    requires(!_pipeline_generator<std::decay_t<Source>> && std::ranges::input_range<Source>)
+pipeline(Source&&, size_t = 64) -> pipeline<std::ranges::range_value_t<Source>>;
+
+}  // namespace qk::threading
+
+#endif
+
+#endif  // PIPELINE_H
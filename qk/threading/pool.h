@@ -0,0 +1,299 @@
+#ifndef POOL_H
+#define POOL_H
+
+#ifdef QK_THREADING
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../api.h"
+
+namespace qk::threading {
+
+template <typename T>
+struct pool;
+
+// tells pools apart in the per thread caches, never reused unlike addresses
+inline std::atomic<uint64_t> _pool_ids = 1;
+
+/// a value borrowed from a 'pool' that goes back to it when the handle is destroyed, it can be
+/// moved through a 'channel' so the consumer returns the buffer the producer took
+///
+///     @code
+///     pool<std::string> lines;
+///     channel<pooled<std::string>> out(64);
+///
+///     auto line = lines.lease();
+///     format_into(*line, event);
+///     out.send(std::move(line));
+///
+///     // on the consumer, the string goes back to 'lines' once 'l' goes out of scope
+///     while (auto l = out.receive()) write(**l);
+///     @endcode
+template <typename T>
+struct QK_API pooled {
+    pool<T>* _owner = nullptr;
+    T _value{};
+
+    pooled() = default;
+    pooled(pool<T>* owner, T&& value) : _owner(owner), _value(std::move(value)) {}
+
+    pooled(pooled&& other) noexcept
+        : _owner(std::exchange(other._owner, nullptr)), _value(std::move(other._value)) {}
+
+    pooled& operator=(pooled&& other) noexcept {
+        if (this != &other) {
+            reset();
+            _owner = std::exchange(other._owner, nullptr);
+            _value = std::move(other._value);
+        }
+        return *this;
+    }
+
+    pooled(const pooled&) = delete;
+    pooled& operator=(const pooled&) = delete;
+
+    ~pooled() { reset(); }
+
+    T& operator*() { return _value; }
+    const T& operator*() const { return _value; }
+    T* operator->() { return &_value; }
+    const T* operator->() const { return &_value; }
+
+    /// returns the value to its pool early, the handle is empty afterwards
+    void reset() {
+        if (_owner) std::exchange(_owner, nullptr)->put(std::move(_value));
+    }
+
+    /// takes the value out for good, it is not returned to the pool
+    T release() {
+        _owner = nullptr;
+        return std::move(_value);
+    }
+};
+
+/// a go style 'sync.Pool', keeps idle objects around so hot paths can reuse them instead of going
+/// through the allocator every time, meant for scratch buffers like 'std::string' or
+/// 'std::vector<std::byte>' whose capacity survives being moved in and out
+///
+/// every thread has its own free list of up to 'local_capacity' objects, a thread that runs out or
+/// fills up moves half a list at once from or to a shared overflow list, so a producer and a
+/// consumer on different threads keep recycling the same buffers with one lock per batch
+///
+/// objects that sat unused for a whole 'trim_interval' are destroyed, trimming runs from the slow
+/// path when the interval passed and can be triggered with 'trim', for example once per frame
+///
+/// values with a 'clear' member are cleared when they are put back, so recycled strings and vectors
+/// come back empty but keep their capacity
+///
+/// @note
+/// the first use of a pool on a thread allocates that threads free list, after that getting and
+/// putting values never allocates, objects still in the free list of a thread that exits are
+/// destroyed
+template <typename T>
+struct QK_API pool {
+    struct _local {
+        // taken by the owning thread on every operation, and by 'trim' and the destructor
+        std::mutex mu;
+        std::vector<T> items;
+
+        // the fewest items the list held since the last trim, that many were never used
+        size_t low = 0;
+
+        std::atomic_bool dead = false;  // the pool is gone
+        bool orphaned = false;          // the thread is gone, under 'mu'
+    };
+
+    // the free lists of one thread, one entry per pool it used
+    struct _thread_cache {
+        struct entry {
+            uint64_t id;
+            std::shared_ptr<_local> local;
+        };
+        std::vector<entry> entries;
+
+        ~_thread_cache() {
+            for (auto& e : entries) {
+                std::lock_guard l(e.local->mu);
+                e.local->items.clear();
+                e.local->orphaned = true;
+            }
+        }
+    };
+
+    std::function<T()> _make;
+    size_t _local_capacity;
+    uint64_t _id = _pool_ids.fetch_add(1, std::memory_order_relaxed);
+
+    std::chrono::steady_clock::duration _trim_interval;
+    std::atomic<std::chrono::steady_clock::rep> _last_trim;
+
+    // guards the overflow list and the registry, taken before any '_local::mu'
+    std::mutex _mu;
+    std::vector<T> _overflow;
+    size_t _overflow_capacity;
+    size_t _overflow_low = 0;
+    std::vector<std::shared_ptr<_local>> _locals;
+
+    /// 'make' creates objects when no idle one is around, every thread keeps up to
+    /// 'local_capacity' idle objects and the shared overflow list holds up to that many per
+    /// hardware thread
+    explicit pool(
+        std::function<T()> make = [] { return T(); },
+        size_t local_capacity = 64,
+        std::chrono::steady_clock::duration trim_interval = std::chrono::seconds(1)
+    )
+        : _make(std::move(make)),
+          _local_capacity(std::max<size_t>(local_capacity, 2)),
+          _trim_interval(trim_interval),
+          _last_trim(std::chrono::steady_clock::now().time_since_epoch().count()),
+          _overflow_capacity(
+              _local_capacity * std::max<size_t>(std::thread::hardware_concurrency(), 1)
+          ) {
+        _overflow.reserve(_overflow_capacity);
+    }
+
+    ~pool() {
+        std::lock_guard l(_mu);
+        for (auto& local : _locals) {
+            std::lock_guard ll(local->mu);
+            local->items.clear();
+            local->dead = true;
+        }
+    }
+
+    pool(const pool&) = delete;
+    pool& operator=(const pool&) = delete;
+
+    // the free list of this thread, created and registered on first use
+    _local& _local_list() {
+        thread_local _thread_cache cache;
+        for (auto& e : cache.entries) {
+            if (e.id == _id) return *e.local;
+        }
+
+        std::erase_if(cache.entries, [](auto& e) { return e.local->dead.load(); });
+        auto local = std::make_shared<_local>();
+        local->items.reserve(_local_capacity);
+        {
+            std::lock_guard l(_mu);
+            _locals.push_back(local);
+        }
+        cache.entries.push_back({_id, local});
+        return *local;
+    }
+
+    void _maybe_trim() {
+        auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        auto last = _last_trim.load(std::memory_order_relaxed);
+        if (now - last < _trim_interval.count()) return;
+        if (_last_trim.compare_exchange_strong(last, now, std::memory_order_relaxed)) trim();
+    }
+
+    /// returns an idle object, or a new one from 'make' if there is none
+    T get() {
+        _local& local = _local_list();
+        {
+            std::lock_guard l(local.mu);
+            if (!local.items.empty()) {
+                T val = std::move(local.items.back());
+                local.items.pop_back();
+                local.low = std::min(local.low, local.items.size());
+                return val;
+            }
+        }
+
+        _maybe_trim();
+        {
+            std::scoped_lock l(_mu, local.mu);
+            if (!_overflow.empty()) {
+                // the newest objects are the most likely to still be in cache
+                size_t n = std::min(_overflow.size(), _local_capacity / 2);
+                auto first = _overflow.end() - std::ptrdiff_t(n);
+                std::move(first, _overflow.end(), std::back_inserter(local.items));
+                _overflow.erase(first, _overflow.end());
+                _overflow_low = std::min(_overflow_low, _overflow.size());
+
+                T val = std::move(local.items.back());
+                local.items.pop_back();
+                local.low = std::min(local.low, local.items.size());
+                return val;
+            }
+        }
+        return _make();
+    }
+
+    /// hands 'val' back for reuse, objects beyond what the pool keeps are destroyed
+    void put(T&& val) {
+        if constexpr (requires { val.clear(); }) val.clear();
+
+        _local& local = _local_list();
+        {
+            std::lock_guard l(local.mu);
+            if (local.items.size() < _local_capacity) {
+                local.items.push_back(std::move(val));
+                return;
+            }
+        }
+
+        _maybe_trim();
+        std::scoped_lock l(_mu, local.mu);
+
+        // spill the older half so this thread keeps the objects it touched last
+        size_t n = std::min(local.items.size() / 2, _overflow_capacity - _overflow.size());
+        auto last = local.items.begin() + std::ptrdiff_t(n);
+        std::move(local.items.begin(), last, std::back_inserter(_overflow));
+        local.items.erase(local.items.begin(), last);
+        local.low = std::min(local.low, local.items.size());
+
+        if (local.items.size() < _local_capacity) local.items.push_back(std::move(val));
+    }
+
+    /// same as 'get' but returns a handle that puts the object back once it is destroyed
+    pooled<T> lease() { return pooled<T>(this, get()); }
+
+    /// destroys every object that stayed idle since the previous trim, and forgets the free lists
+    /// of threads that exited
+    void trim() {
+        std::lock_guard l(_mu);
+        std::erase_if(_locals, [](const std::shared_ptr<_local>& local) {
+            std::lock_guard ll(local->mu);
+            if (local->orphaned) return true;
+
+            // the list is used from the back, so the front holds the idle objects
+            auto idle = local->items.begin() + std::ptrdiff_t(local->low);
+            local->items.erase(local->items.begin(), idle);
+            local->low = local->items.size();
+            return false;
+        });
+
+        _overflow.erase(_overflow.begin(), _overflow.begin() + std::ptrdiff_t(_overflow_low));
+        _overflow_low = _overflow.size();
+    }
+
+    /// number of idle objects held across every thread, a snapshot for diagnostics
+    size_t idle() {
+        std::lock_guard l(_mu);
+        size_t count = _overflow.size();
+        for (auto& local : _locals) {
+            std::lock_guard ll(local->mu);
+            count += local->items.size();
+        }
+        return count;
+    }
+};
+
+}  // namespace qk::threading
+
+#endif
+
+#endif  // POOL_H
@@ -0,0 +1,226 @@
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#ifdef QK_THREADING
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include "../api.h"
+#include "context.h"
+#include "gorutines.h"
+#include "sync.h"
+
+namespace qk::threading {
+
+// the shape of 'qk::utils::Rate', matched structurally so the threading module does not depend
+// on the utils module
+template <typename R>
+concept _rate_like = requires(const R& r) {
+    { static_cast<double>(r.amount) };
+    { std::chrono::duration_cast<std::chrono::nanoseconds>(r.interval) };
+};
+
+/// a token bucket rate limiter, it refills at 'amount' tokens per 'interval' and holds at most
+/// 'burst' tokens, so after an idle stretch up to 'burst' takes go through at once before the
+/// steady rate kicks in
+///
+/// it accepts a 'qk::utils::Rate' directly, so limits can come from config strings
+///
+///     @code
+///     token_bucket uploads("20/1s"_rate, 5);
+///     for (auto& chunk : chunks) {
+///         uploads.take();
+///         send(chunk);
+///     }
+///     @endcode
+///
+/// the bucket is stored as the time at which it would be full again (the generic cell rate
+/// algorithm), so taking tokens is a single compare and swap and never locks
+struct QK_API token_bucket {
+    using clock = std::chrono::steady_clock;
+
+    // nanoseconds it takes to refill one token
+    double _interval_ns;
+    double _burst;
+
+    // nanoseconds since the clock epoch at which every token taken so far is paid back
+    alignas(cache_line_size) std::atomic<int64_t> _full_at;
+
+    /// 'burst' values below 1 are raised to 1
+    token_bucket(double amount, std::chrono::nanoseconds interval, double burst = 1)
+        : _interval_ns(double(interval.count()) / std::max(amount, 1e-9)),
+          _burst(std::max(burst, 1.0)),
+          _full_at(_now()) {}
+
+    /// creates a bucket from a 'qk::utils::Rate' or anything shaped like it
+    template <_rate_like R>
+    explicit token_bucket(const R& rate, double burst = 1)
+        : token_bucket(
+              double(rate.amount),
+              std::chrono::duration_cast<std::chrono::nanoseconds>(rate.interval),
+              burst
+          ) {}
+
+    token_bucket(const token_bucket&) = delete;
+    token_bucket& operator=(const token_bucket&) = delete;
+
+    static int64_t _now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch())
+            .count();
+    }
+
+    // takes 'n' tokens if they would be available within 'max_wait' nanoseconds, returns how long
+    // the caller has to wait before using them
+    std::optional<int64_t> _reserve(double n, int64_t max_wait) {
+        int64_t now = _now();
+        int64_t cost = std::llround(n * _interval_ns);
+        int64_t tolerance = std::llround(_burst * _interval_ns);
+
+        int64_t full_at = _full_at.load(std::memory_order_relaxed);
+        while (true) {
+            int64_t next = std::max(full_at, now) + cost;
+            int64_t wait = std::max<int64_t>(next - tolerance - now, 0);
+            if (wait > max_wait) return std::nullopt;
+
+            if (_full_at.compare_exchange_weak(full_at, next, std::memory_order_relaxed)) {
+                return wait;
+            }
+        }
+    }
+
+    /// takes 'n' tokens if they are available right now, returns false otherwise
+    bool try_take(double n = 1) { return _reserve(n, 0).has_value(); }
+
+    /// takes 'n' tokens, sleeping until they are available
+    ///
+    /// the tokens are claimed up front, so concurrent callers are served in the order they called
+    /// in and none of them can starve
+    void take(double n = 1) {
+        int64_t wait = *_reserve(n, INT64_MAX);
+        if (wait > 0) std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+    }
+
+    /// same as 'take' but gives up once 'ctx' is done, returns false if it is, in which case the
+    /// tokens are handed back
+    bool take(double n, const context& ctx) {
+        int64_t max_wait = INT64_MAX;
+        if (auto deadline = ctx.deadline()) {
+            auto left = *deadline - clock::now();
+            max_wait = std::max<int64_t>(std::chrono::nanoseconds(left).count(), 0);
+        }
+        if (ctx.done()) return false;
+
+        std::optional<int64_t> wait = _reserve(n, max_wait);
+        if (!wait) return false;  // the deadline passes before the tokens are there
+        if (*wait == 0) return true;
+
+        std::mutex mu;
+        std::condition_variable_any cv;
+        std::unique_lock l(mu);
+        auto until = clock::now() + std::chrono::nanoseconds(*wait);
+        cv.wait_until(l, ctx.stop_token(), until, [] { return false; });
+        if (ctx.stop_token().stop_requested()) {
+            refund(n);
+            return false;
+        }
+        return true;
+    }
+
+    /// hands back 'n' tokens that were taken but not used
+    void refund(double n = 1) {
+        _full_at.fetch_sub(std::llround(n * _interval_ns), std::memory_order_relaxed);
+    }
+
+    /// tokens available right now
+    double available() const {
+        int64_t ahead = std::max<int64_t>(_full_at.load(std::memory_order_relaxed) - _now(), 0);
+        return std::max(_burst - double(ahead) / _interval_ns, 0.0);
+    }
+};
+
+/// a 'channel' that lets values out no faster than a rate, with a burst allowance, producers send
+/// as usual and are held back by the channel filling up, so they need no sleep loops of their own
+///
+///     @code
+///     rate_limited_channel<packet> outgoing(256, "50/1s"_rate, 10);
+///     go([&] {
+///         for (auto& p : outgoing) socket.write(p);  // at most 50 packets per second
+///     });
+///     outgoing.send(make_packet());
+///     @endcode
+///
+/// the limit applies to all receivers together, a receiver first waits for a value and then for a
+/// token, so closing the channel never has to wait for the limiter
+template <typename T>
+struct QK_API rate_limited_channel : _channel_ops<rate_limited_channel<T>, T> {
+    channel<T> _ch;
+    token_bucket _bucket;
+
+    /// 'capacity' is that of the underlying 'channel', values leave at up to 'amount' per
+    /// 'interval' with up to 'burst' at once
+    rate_limited_channel(
+        size_t capacity, double amount, std::chrono::nanoseconds interval, double burst = 1
+    )
+        : _ch(capacity), _bucket(amount, interval, burst) {}
+
+    /// same as above with the rate given as a 'qk::utils::Rate' or anything shaped like it
+    template <_rate_like R>
+    rate_limited_channel(size_t capacity, const R& rate, double burst = 1)
+        : _ch(capacity), _bucket(rate, burst) {}
+
+    bool send(const T& val) { return _ch.send(val); }
+    bool send(T&& val) { return _ch.send(std::move(val)); }
+    bool send(const T& val, const context& ctx) { return _ch.send(val, ctx); }
+    bool send(T&& val, const context& ctx) { return _ch.send(std::move(val), ctx); }
+    bool try_send(const T& val) { return _ch.try_send(val); }
+    bool try_send(T&& val) { return _ch.try_send(std::move(val)); }
+
+    /// receives a value, waiting for one to arrive and then for the limiter to let it out
+    std::optional<T> receive() {
+        std::optional<T> val = _ch.receive();
+        if (val) _bucket.take();
+        return val;
+    }
+
+    /// same as 'receive' but gives up once 'ctx' is done, a value that was already taken from the
+    /// channel when 'ctx' ends is returned without waiting for the limiter
+    std::optional<T> receive(const context& ctx) {
+        std::optional<T> val = _ch.receive(ctx);
+        if (val) _bucket.take(1, ctx);
+        return val;
+    }
+
+    /// receives a value only if one is queued and the limiter lets it out right away
+    std::optional<T> try_receive() {
+        if (!_bucket.try_take()) return std::nullopt;
+
+        std::optional<T> val = _ch.try_receive();
+        if (!val) _bucket.refund();
+        return val;
+    }
+
+    void close() { _ch.close(); }
+    bool is_closed() const { return _ch.is_closed(); }
+
+    /// number of values waiting in the channel, see 'channel::size'
+    size_t size() const { return _ch.size(); }
+
+    /// the limiter, it can be shared with other code paths that draw on the same budget
+    token_bucket& limiter() { return _bucket; }
+};
+
+}  // namespace qk::threading
+
+#endif
+
+#endif  // RATE_LIMIT_H
@@ -0,0 +1,187 @@
+#include "scheduler.h"
+
+#include <algorithm>
+
+#ifdef QK_THREADING
+
+namespace qk::threading {
+
+// set for the lifetime of each worker thread, used to route spawns from inside a worker to its
+// local deque
+static thread_local _worker* current_worker = nullptr;
+
+bool ws_deque::push(task* t) {
+    int64_t b = _bottom.load(std::memory_order_relaxed);
+    int64_t top = _top.load(std::memory_order_acquire);
+    if (b - top >= capacity) return false;
+
+    _buffer[b & mask].store(t, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+task* ws_deque::pop() {
+    int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+    _bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = _top.load(std::memory_order_relaxed);
+
+    if (top > b) {
+        _bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    task* t = _buffer[b & mask].load(std::memory_order_relaxed);
+    if (top == b) {
+        // last element, race against thieves for it
+        if (!_top.compare_exchange_strong(
+                top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed
+            )) {
+            t = nullptr;
+        }
+        _bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return t;
+}
+
+task* ws_deque::steal() {
+    while (true) {
+        int64_t top = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = _bottom.load(std::memory_order_acquire);
+        if (top >= b) return nullptr;
+
+        task* t = _buffer[top & mask].load(std::memory_order_relaxed);
+        if (_top.compare_exchange_strong(
+                top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed
+            )) {
+            return t;
+        }
+        // lost the race to another thief or the owner, someone made progress so try again
+    }
+}
+
+static void wake_all(thread_pool* pool) {
+    pool->_epoch.fetch_add(1);
+    pool->_epoch.notify_all();
+}
+
+static task* pop_injected(thread_pool* pool) {
+    if (pool->_injected_size.load(std::memory_order_relaxed) == 0) return nullptr;
+
+    std::lock_guard l(pool->_inject_mu);
+    if (pool->_injected.empty()) return nullptr;
+
+    task* t = pool->_injected.front();
+    pool->_injected.pop_front();
+    pool->_injected_size.fetch_sub(1, std::memory_order_relaxed);
+    return t;
+}
+
+static task* find_task(thread_pool* pool, _worker* self) {
+    if (task* t = self->deque.pop()) return t;
+    if (task* t = pop_injected(pool)) return t;
+
+    size_t n = pool->_workers.size();
+    for (size_t i = 1; i < n; i++) {
+        if (task* t = pool->_workers[(self->index + i) % n]->deque.steal()) return t;
+    }
+    return nullptr;
+}
+
+static void run_task(thread_pool* pool, task* t) {
+    t->_run(t);
+    if (pool->_pending.fetch_sub(1) == 1 && pool->_stopping.load()) wake_all(pool);
+}
+
+static void worker_loop(thread_pool* pool, _worker* self) {
+    current_worker = self;
+
+    while (true) {
+        if (task* t = find_task(pool, self)) {
+            run_task(pool, t);
+            continue;
+        }
+
+        // announce that we are about to park, then look once more, any submit that happens after
+        // the epoch is read changes it and makes the wait return immediately
+        pool->_idle.fetch_add(1);
+        uint32_t epoch = pool->_epoch.load();
+        task* t = find_task(pool, self);
+        if (!t) {
+            if (pool->_stopping.load() && pool->_pending.load() == 0) {
+                pool->_idle.fetch_sub(1);
+                break;
+            }
+            pool->_epoch.wait(epoch);
+        }
+        pool->_idle.fetch_sub(1);
+
+        if (t) run_task(pool, t);
+    }
+
+    current_worker = nullptr;
+}
+
+thread_pool::thread_pool(size_t workers) {
+    if (workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+
+    _workers.reserve(workers);
+    for (size_t i = 0; i < workers; i++) {
+        auto w = std::make_unique<_worker>();
+        w->pool = this;
+        w->index = i;
+        _workers.push_back(std::move(w));
+    }
+
+    // threads are started only once every worker exists, since they immediately try to steal
+    for (auto& w : _workers) {
+        w->thread = std::jthread([this, w = w.get()] { worker_loop(this, w); });
+    }
+}
+
+thread_pool::~thread_pool() { shutdown(this); }
+
+QK_API bool submit(task* t, thread_pool* pool) {
+    _worker* self = current_worker;
+    bool internal = self && self->pool == pool;
+
+    // pending is raised before checking for shutdown, so workers can not exit between the check and
+    // the push
+    pool->_pending.fetch_add(1);
+    if (pool->_stopping.load() && !internal) {
+        if (pool->_pending.fetch_sub(1) == 1) wake_all(pool);
+        return false;
+    }
+
+    if (!internal || !self->deque.push(t)) {
+        std::lock_guard l(pool->_inject_mu);
+        pool->_injected.push_back(t);
+        pool->_injected_size.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    pool->_epoch.fetch_add(1);
+    if (pool->_idle.load() > 0) pool->_epoch.notify_one();
+    return true;
+}
+
+QK_API void shutdown(thread_pool* pool) {
+    pool->_stopping = true;
+    wake_all(pool);
+
+    for (auto& w : pool->_workers) {
+        if (w->thread.joinable()) w->thread.join();
+    }
+}
+
+QK_API size_t worker_count(const thread_pool* pool) { return pool->_workers.size(); }
+
+QK_API thread_pool* default_pool() {
+    static thread_pool pool;
+    return &pool;
+}
+
+}  // namespace qk::threading
+
+#endif
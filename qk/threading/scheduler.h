@@ -0,0 +1,136 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#ifdef QK_THREADING
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../api.h"
+#include "sync.h"
+
+namespace qk::threading {
+
+/// type erased unit of work executed by a 'thread_pool', tasks are heap allocated and free
+/// themselves after running
+struct QK_API task {
+    void (*_run)(task*) = nullptr;
+};
+
+template <typename Func>
+struct _task_box : task {
+    Func func;
+
+    explicit _task_box(Func&& f) : func(std::move(f)) { _run = &run; }
+
+    static void run(task* t) {
+        auto self = static_cast<_task_box*>(t);
+        self->func();
+        delete self;
+    }
+};
+
+/// bounded chase-lev work stealing deque, the owning worker pushes and pops from the bottom while
+/// other workers steal from the top
+///
+/// when the deque is full 'push' fails and the caller is expected to fall back to the shared
+/// injection queue of the pool
+struct QK_API ws_deque {
+    static constexpr int64_t capacity = 1024;
+    static constexpr int64_t mask = capacity - 1;
+
+    alignas(cache_line_size) std::atomic<int64_t> _top = 0;
+    alignas(cache_line_size) std::atomic<int64_t> _bottom = 0;
+    alignas(cache_line_size) std::array<std::atomic<task*>, capacity> _buffer{};
+
+    /// only safe to call from the owning worker
+    bool push(task* t);
+
+    /// only safe to call from the owning worker
+    task* pop();
+
+    /// safe to call from any thread
+    task* steal();
+};
+
+struct thread_pool;
+
+struct QK_API _worker {
+    ws_deque deque;
+    std::jthread thread;
+    thread_pool* pool = nullptr;
+    size_t index = 0;
+};
+
+/// a fixed set of worker threads with per worker work stealing deques, used to run many small
+/// tasks without paying for thread creation on each spawn
+///
+/// tasks spawned from inside a worker go to that workers local deque, tasks spawned from outside
+/// go through a shared injection queue, idle workers steal from each other before parking
+///
+/// unlike 'go', tasks submitted to a pool share a limited number of threads, so a task that blocks
+/// forever (for example on an unbuffered channel waiting for another pooled task) can starve the
+/// pool, use 'go' for long-lived or blocking work
+struct QK_API thread_pool {
+    std::vector<std::unique_ptr<_worker>> _workers;
+
+    std::mutex _inject_mu;
+    std::deque<task*> _injected;
+    std::atomic<size_t> _injected_size = 0;
+
+    alignas(cache_line_size) std::atomic<size_t> _pending = 0;
+    alignas(cache_line_size) std::atomic<uint32_t> _epoch = 0;
+    std::atomic<int> _idle = 0;
+    std::atomic_bool _stopping = false;
+
+    /// creates a pool with 'workers' threads, 0 uses 'std::thread::hardware_concurrency'
+    explicit thread_pool(size_t workers = 0);
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+};
+
+/// submits a type erased task to the pool, returns false if the pool is shutting down, in which
+/// case ownership of the task stays with the caller
+QK_API bool submit(task* t, thread_pool* pool);
+
+/// stops accepting new tasks from outside the pool, runs every queued task to completion (including
+/// tasks spawned by those tasks) and joins the workers
+///
+/// must not be called from one of the pools own workers
+QK_API void shutdown(thread_pool* pool);
+
+/// returns the number of worker threads in the pool
+QK_API size_t worker_count(const thread_pool* pool);
+
+/// returns a lazily created process wide pool sized to the hardware concurrency, it is drained and
+/// joined during static destruction
+QK_API thread_pool* default_pool();
+
+/// same as 'go' but runs the function on a 'thread_pool' instead of a fresh thread, returns false
+/// if the pool is shutting down
+template <typename Func, typename... Args>
+bool go_on(thread_pool* pool, Func&& func, Args&&... args) {
+    auto bound = [func = std::forward<Func>(func), ... args = std::forward<Args>(args)]() mutable {
+        func(std::forward<Args>(args)...);
+    };
+
+    auto t = new _task_box<decltype(bound)>(std::move(bound));
+    if (!submit(t, pool)) {
+        delete t;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace qk::threading
+
+#endif
+
+#endif  // SCHEDULER_H
@@ -0,0 +1,368 @@
+#ifndef SELECT_H
+#define SELECT_H
+
+#ifdef QK_THREADING
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <semaphore>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "../api.h"
+#include "gorutines.h"
+
+namespace qk::threading {
+
+template <typename T, typename Func>
+struct _recv_case {
+    channel<T>* ch;
+    Func fn;
+};
+
+template <typename T, typename Func>
+struct _send_case {
+    channel<T>* ch;
+    T val;
+    Func fn;
+};
+
+template <typename Func>
+struct _default_case {
+    Func fn;
+};
+
+template <typename Func>
+struct _timeout_case {
+    std::chrono::steady_clock::duration timeout;
+    Func fn;
+};
+
+/// a 'select' case receiving from 'ch', 'fn' is called with the received 'std::optional<T>' which
+/// is empty if the channel was closed, 'fn' can also take no arguments
+template <typename T, typename Func>
+_recv_case<T, std::decay_t<Func>> case_recv(channel<T>& ch, Func&& fn) {
+    return {&ch, std::forward<Func>(fn)};
+}
+
+/// a 'select' case sending 'val' through 'ch', 'fn' is called without arguments once the value was
+/// sent, like in go a closed channel never lets this case complete
+template <typename T, typename U, typename Func>
+_send_case<T, std::decay_t<Func>> case_send(channel<T>& ch, U&& val, Func&& fn) {
+    return {&ch, T(std::forward<U>(val)), std::forward<Func>(fn)};
+}
+
+/// a 'select' case that runs when no other case is ready, this makes the select non-blocking
+template <typename Func>
+_default_case<std::decay_t<Func>> default_case(Func&& fn) {
+    return {std::forward<Func>(fn)};
+}
+
+/// a 'select' case that runs if no other case became ready within 'timeout'
+template <typename Rep, typename Period, typename Func>
+_timeout_case<std::decay_t<Func>> timeout_case(
+    std::chrono::duration<Rep, Period> timeout, Func&& fn
+) {
+    return {std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout),
+            std::forward<Func>(fn)};
+}
+
+template <typename T>
+struct _is_default_case : std::false_type {};
+template <typename Func>
+struct _is_default_case<_default_case<Func>> : std::true_type {};
+
+template <typename T>
+struct _is_timeout_case : std::false_type {};
+template <typename Func>
+struct _is_timeout_case<_timeout_case<Func>> : std::true_type {};
+
+// what a case parks on its channel while the select waits, cases without a channel park nothing
+struct _no_waiter {};
+
+template <typename Case>
+struct _case_waiter {
+    using type = _no_waiter;
+};
+template <typename T, typename Func>
+struct _case_waiter<_recv_case<T, Func>> {
+    using type = typename channel<T>::_waiter;
+};
+template <typename T, typename Func>
+struct _case_waiter<_send_case<T, Func>> {
+    using type = typename channel<T>::_waiter;
+};
+
+template <typename Case>
+using _case_waiter_t = typename _case_waiter<std::decay_t<Case>>::type;
+
+template <typename T, typename Func>
+std::mutex* _case_mutex(_recv_case<T, Func>& c) {
+    return &c.ch->_mu;
+}
+
+template <typename T, typename Func>
+std::mutex* _case_mutex(_send_case<T, Func>& c) {
+    return &c.ch->_mu;
+}
+
+template <typename Case>
+std::mutex* _case_mutex(Case&) {
+    return nullptr;
+}
+
+// the cases below run with every channel of the select locked
+
+// a receive is ready once a value can be taken or the channel is closed, the value (empty if
+// closed) is left in 'w' for '_finish_case'
+template <typename T, typename Func>
+bool _ready_case(_recv_case<T, Func>& c, typename channel<T>::_waiter& w) {
+    w._value = c.ch->_take();
+    return w._value || c.ch->_closed.load();
+}
+
+template <typename T, typename Func>
+bool _ready_case(_send_case<T, Func>& c, typename channel<T>::_waiter&) {
+    return !c.ch->_closed.load() && c.ch->_offer(std::move(c.val));
+}
+
+template <typename Case>
+bool _ready_case(Case&, _no_waiter&) {
+    return false;
+}
+
+template <typename T, typename Func>
+void _park_case(
+    _recv_case<T, Func>& c, typename channel<T>::_waiter& w, _select_claim* claim, size_t i
+) {
+    w._select = claim;
+    w._case = i;
+    w._parker = &_thread_parker();
+    c.ch->_parked_receivers.push_back(&w);
+}
+
+template <typename T, typename Func>
+void _park_case(
+    _send_case<T, Func>& c, typename channel<T>::_waiter& w, _select_claim* claim, size_t i
+) {
+    // a closed channel never takes the value, so there is nothing to wait for
+    if (c.ch->_closed.load()) {
+        w._woken = true;
+        return;
+    }
+
+    w._value.emplace(std::move(c.val));
+    w._select = claim;
+    w._case = i;
+    w._parker = &_thread_parker();
+    c.ch->_parked_senders.push_back(&w);
+}
+
+template <typename Case>
+void _park_case(Case&, _no_waiter&, _select_claim*, size_t) {}
+
+// unlinks a registration no channel has taken yet
+template <typename T, typename Func>
+void _withdraw_case(_recv_case<T, Func>& c, typename channel<T>::_waiter& w) {
+    if (!w._woken) c.ch->_parked_receivers.erase(&w);
+}
+
+template <typename T, typename Func>
+void _withdraw_case(_send_case<T, Func>& c, typename channel<T>::_waiter& w) {
+    if (!w._woken) c.ch->_parked_senders.erase(&w);
+}
+
+template <typename Case>
+void _withdraw_case(Case&, _no_waiter&) {}
+
+// runs the callback of the case that completed, outside of the channel locks
+template <typename T, typename Func>
+void _finish_case(_recv_case<T, Func>& c, typename channel<T>::_waiter& w) {
+    if constexpr (std::invocable<Func&, std::optional<T>>) {
+        c.fn(std::move(w._value));
+    } else {
+        c.fn();
+    }
+}
+
+template <typename T, typename Func>
+void _finish_case(_send_case<T, Func>& c, typename channel<T>::_waiter&) {
+    c.fn();
+}
+
+template <typename Case>
+void _finish_case(Case&, _no_waiter&) {}
+
+// the distinct channel mutexes of a select, always locked in address order so selects over the
+// same channels cannot deadlock each other
+template <size_t N>
+struct _select_locks {
+    std::array<std::mutex*, N> mu{};
+    size_t size = 0;
+
+    void add(std::mutex* m) {
+        if (m) mu[size++] = m;
+    }
+
+    void sort() {
+        std::sort(mu.begin(), mu.begin() + size, std::less<>{});
+        size = size_t(std::unique(mu.begin(), mu.begin() + size) - mu.begin());
+    }
+
+    void lock() {
+        for (size_t i = 0; i < size; i++) {
+            mu[i]->lock();
+        }
+    }
+
+    void unlock() {
+        for (size_t i = size; i > 0; i--) {
+            mu[i - 1]->unlock();
+        }
+    }
+};
+
+// cheap per thread xorshift, only used to pick the case a select starts scanning from
+inline uint32_t _select_random() {
+    thread_local uint32_t state =
+        0x9e3779b9u ^
+        static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// runs the callback of the case matching 'Kind' and returns its index
+template <template <typename> typename Kind, typename Tuple, size_t... I>
+size_t _run_case_of(Tuple& all, std::index_sequence<I...>) {
+    size_t index = sizeof...(I);
+    (
+        [&] {
+            if constexpr (Kind<std::decay_t<std::tuple_element_t<I, Tuple>>>::value) {
+                std::get<I>(all).fn();
+                index = I;
+            }
+        }(),
+        ...
+    );
+    return index;
+}
+
+template <typename Tuple, size_t... I>
+std::chrono::steady_clock::duration _timeout_of(Tuple& all, std::index_sequence<I...>) {
+    std::chrono::steady_clock::duration timeout{};
+    (
+        [&] {
+            if constexpr (_is_timeout_case<std::decay_t<std::tuple_element_t<I, Tuple>>>::value) {
+                timeout = std::get<I>(all).timeout;
+            }
+        }(),
+        ...
+    );
+    return timeout;
+}
+
+/// waits on several channel operations at once and runs the callback of exactly one of them, like
+/// the go select statement, returns the index of the case that ran
+///
+/// cases are built with 'case_recv', 'case_send', 'default_case' and 'timeout_case', if several
+/// cases are ready one is picked at random so no channel is starved
+///
+///     @code
+///     select(
+///         case_recv(jobs, [](std::optional<job> j) { ... }),
+///         case_send(results, r, [] { ... }),
+///         timeout_case(std::chrono::milliseconds(16), [] { ... })
+///     );
+///     @endcode
+///
+/// a blocking select parks on every involved channel at once, the first channel that claims it
+/// completes exactly one case and wakes the thread, every other registration is withdrawn before
+/// 'select' returns, so no value is ever handed to a select that took a different case
+template <typename... Cases>
+size_t select(Cases&&... cases) {
+    constexpr size_t count = sizeof...(Cases);
+    constexpr size_t defaults = (0 + ... + _is_default_case<std::decay_t<Cases>>::value);
+    constexpr size_t timeouts = (0 + ... + _is_timeout_case<std::decay_t<Cases>>::value);
+    static_assert(count > 0, "select needs at least one case");
+    static_assert(defaults <= 1, "select can have at most one default case");
+    static_assert(timeouts <= 1, "select can have at most one timeout case");
+
+    auto all = std::forward_as_tuple(cases...);
+    std::tuple<_case_waiter_t<Cases>...> waiters;
+    constexpr auto indices = std::make_index_sequence<count>{};
+
+    auto each = [&]<size_t... I>(std::index_sequence<I...>, auto&& fn) {
+        (fn(std::get<I>(all), std::get<I>(waiters), I), ...);
+    };
+    auto at = [&]<size_t... I>(std::index_sequence<I...>, size_t i, auto&& fn) {
+        bool result = false;
+        (
+            [&] {
+                if (i == I) result = fn(std::get<I>(all), std::get<I>(waiters));
+            }(),
+            ...
+        );
+        return result;
+    };
+
+    _select_locks<count> locks;
+    each(indices, [&](auto& c, auto&, size_t) { locks.add(_case_mutex(c)); });
+    locks.sort();
+
+    auto deadline = std::chrono::steady_clock::now() + _timeout_of(all, indices);
+    size_t start = _select_random() % count;
+    size_t ready = count;
+
+    locks.lock();
+    for (size_t k = 0; k < count && ready == count; k++) {
+        size_t i = (start + k) % count;
+        if (at(indices, i, [](auto& c, auto& w) { return _ready_case(c, w); })) ready = i;
+    }
+
+    if (ready == count) {
+        if constexpr (defaults > 0) {
+            locks.unlock();
+            return _run_case_of<_is_default_case>(all, indices);
+        }
+
+        _select_claim claim;
+        each(indices, [&](auto& c, auto& w, size_t i) { _park_case(c, w, &claim, i); });
+        locks.unlock();
+
+        std::binary_semaphore& parker = _thread_parker();
+        if constexpr (timeouts > 0) {
+            // claiming the select for the timeout fails if a channel got there first, its release
+            // is then on the way and has to be consumed so the parker stays balanced
+            if (!parker.try_acquire_until(deadline) && !claim.claim(count)) parker.acquire();
+        } else {
+            parker.acquire();
+        }
+
+        locks.lock();
+        each(indices, [](auto& c, auto& w, size_t) { _withdraw_case(c, w); });
+        ready = claim.winner.load(std::memory_order_acquire);
+    }
+    locks.unlock();
+
+    if (ready == count) return _run_case_of<_is_timeout_case>(all, indices);
+    at(indices, ready, [](auto& c, auto& w) {
+        _finish_case(c, w);
+        return true;
+    });
+    return ready;
+}
+
+}  // namespace qk::threading
+
+#endif
+
+#endif  // SELECT_H
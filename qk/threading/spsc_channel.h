@@ -0,0 +1,174 @@
+#ifndef SPSC_CHANNEL_H
+#define SPSC_CHANNEL_H
+
+#ifdef QK_THREADING
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include "../api.h"
+#include "gorutines.h"
+#include "sync.h"
+
+namespace qk::threading {
+
+/// a lock free channel for exactly one sending and one receiving thread, backed by a fixed power of
+/// two ring buffer
+///
+/// it supports the same '<<', '~', iterator and 'close' semantics as 'channel' so it can be swapped
+/// in with a type change, the differences being:
+///
+///     - the capacity is rounded up to a power of two and is at least 1, there is no unbuffered
+///     rendezvous mode
+///     - the channel can not be moved, since the indices live on separate cache lines
+///     - using more than one sender or receiver at a time is undefined behaviour
+///
+/// both sides spin and yield for a short while before parking on an atomic wait, so handoffs
+/// between two busy threads never enter the kernel
+template <typename T>
+struct QK_API spsc_channel : _channel_ops<spsc_channel<T>, T> {
+    static constexpr int spin_limit = 64;
+    static constexpr int yield_limit = 16;
+
+    struct _slot {
+        alignas(T) std::byte data[sizeof(T)];
+    };
+
+    std::unique_ptr<_slot[]> _slots;
+    size_t _mask = 0;
+    std::atomic_bool _closed = false;
+
+    // consumer owned line, '_cached_tail' avoids touching the producers line while data is known
+    // to be available
+    alignas(cache_line_size) std::atomic<size_t> _head = 0;
+    size_t _cached_tail = 0;
+
+    // producer owned line
+    alignas(cache_line_size) std::atomic<size_t> _tail = 0;
+    size_t _cached_head = 0;
+
+    // parking state, only written when a side actually goes to sleep
+    alignas(cache_line_size) std::atomic_bool _consumer_parked = false;
+    std::atomic<uint32_t> _data_signal = 0;
+    alignas(cache_line_size) std::atomic_bool _producer_parked = false;
+    std::atomic<uint32_t> _space_signal = 0;
+
+    spsc_channel(size_t capacity = 1)
+        : _slots(std::make_unique<_slot[]>(std::bit_ceil(std::max<size_t>(capacity, 1)))),
+          _mask(std::bit_ceil(std::max<size_t>(capacity, 1)) - 1) {}
+
+    ~spsc_channel() {
+        for (size_t i = _head.load(); i != _tail.load(); i++) {
+            std::destroy_at(_at(i));
+        }
+    }
+
+    spsc_channel(const spsc_channel&) = delete;
+    spsc_channel& operator=(const spsc_channel&) = delete;
+
+    T* _at(size_t index) { return std::launder(reinterpret_cast<T*>(_slots[index & _mask].data)); }
+
+    size_t capacity() const { return _mask + 1; }
+
+    static void _wake(std::atomic<uint32_t>& signal) {
+        signal.fetch_add(1, std::memory_order_release);
+        signal.notify_all();
+    }
+
+    // spins, yields and then parks until 'ready' returns true or the channel is closed, 'ready' is
+    // evaluated once more after closing is observed so values sent before 'close' are not lost
+    template <typename Ready>
+    bool _wait(std::atomic_bool& parked, std::atomic<uint32_t>& signal, Ready&& ready) {
+        auto closed = [&] { return _closed.load(std::memory_order_acquire); };
+        if (spin_until([&] { return ready() || closed(); }, spin_limit, yield_limit)) {
+            return ready();
+        }
+
+        while (true) {
+            uint32_t seen = signal.load(std::memory_order_acquire);
+            parked.store(true, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (ready() || closed()) {
+                parked.store(false, std::memory_order_relaxed);
+                return ready();
+            }
+
+            signal.wait(seen, std::memory_order_acquire);
+            parked.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    template <typename U>
+    bool _push(U&& val) {
+        if (_closed.load(std::memory_order_acquire)) return false;
+
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _cached_head > _mask) {
+            auto has_space = [&] {
+                _cached_head = _head.load(std::memory_order_acquire);
+                return tail - _cached_head <= _mask;
+            };
+            if (!has_space() && !_wait(_producer_parked, _space_signal, has_space)) return false;
+            if (_closed.load(std::memory_order_acquire)) return false;
+        }
+
+        std::construct_at(_at(tail), std::forward<U>(val));
+        _tail.store(tail + 1, std::memory_order_release);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_consumer_parked.load(std::memory_order_acquire)) _wake(_data_signal);
+        return true;
+    }
+
+    /// sends a value through the channel, used by the '<<' send overload
+    bool send(const T& val) { return _push(val); }
+
+    /// sends a value through the channel, used by the '<<' send overload
+    bool send(T&& val) { return _push(std::move(val)); }
+
+    /// receives a value from the channel, used by both '<<' and '~' operators
+    std::optional<T> receive() {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _cached_tail) {
+            auto has_data = [&] {
+                _cached_tail = _tail.load(std::memory_order_acquire);
+                return head != _cached_tail;
+            };
+            if (!has_data() && !_wait(_consumer_parked, _data_signal, has_data)) {
+                return std::nullopt;
+            }
+        }
+
+        T* slot = _at(head);
+        std::optional<T> val(std::move(*slot));
+        std::destroy_at(slot);
+        _head.store(head + 1, std::memory_order_release);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_producer_parked.load(std::memory_order_acquire)) _wake(_space_signal);
+        return val;
+    }
+
+    /// closes the channel, values already sent can still be received
+    void close() {
+        _closed.store(true, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        _wake(_data_signal);
+        _wake(_space_signal);
+    }
+
+    /// used to check if the channel is closed to know if a value can be sent or recieved from it
+    bool is_closed() const { return _closed.load(); }
+};
+
+}  // namespace qk::threading
+
+#endif
+
+#endif  // SPSC_CHANNEL_H
@@ -0,0 +1,130 @@
+#include "stats.h"
+
+#include <algorithm>
+
+#ifdef QK_THREADING
+
+namespace qk::threading {
+
+#ifdef QK_THREADING_STATS
+
+static std::mutex registry_mu;
+static _goroutine_record* registry_head = nullptr;
+static uint64_t next_goroutine_id = 1;
+
+QK_API void _track_goroutine(_goroutine_record* g) {
+    std::lock_guard l(registry_mu);
+    g->id = next_goroutine_id++;
+    g->_next = registry_head;
+    if (registry_head) registry_head->_prev = g;
+    registry_head = g;
+}
+
+QK_API void _untrack_goroutine(_goroutine_record* g) {
+    std::lock_guard l(registry_mu);
+    if (g->_prev)
+        g->_prev->_next = g->_next;
+    else
+        registry_head = g->_next;
+    if (g->_next) g->_next->_prev = g->_prev;
+}
+
+QK_API std::vector<goroutine_info> goroutines() {
+    std::lock_guard l(registry_mu);
+    std::vector<goroutine_info> out;
+    for (auto g = registry_head; g; g = g->_next) {
+        out.push_back({g->id, g->state.load(std::memory_order_relaxed), g->site, g->created});
+    }
+
+    // the registry is newest first, report in creation order
+    std::ranges::reverse(out);
+    return out;
+}
+
+#else
+
+QK_API std::vector<goroutine_info> goroutines() { return {}; }
+
+#endif
+
+static void append_json_string(std::string& out, const char* s) {
+    out += '"';
+    for (; *s; s++) {
+        switch (*s) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(*s) < 0x20) {
+                    constexpr char hex[] = "0123456789abcdef";
+                    out += "\\u00";
+                    out += hex[(*s >> 4) & 0xf];
+                    out += hex[*s & 0xf];
+                } else {
+                    out += *s;
+                }
+        }
+    }
+    out += '"';
+}
+
+static const char* state_name(goroutine_state state) {
+    switch (state) {
+        case goroutine_state::starting:
+            return "starting";
+        case goroutine_state::running:
+            return "running";
+        case goroutine_state::sending:
+            return "sending";
+        case goroutine_state::receiving:
+            return "receiving";
+    }
+    return "unknown";
+}
+
+QK_API std::string to_json(const channel_stats& stats) {
+    std::string out = "{";
+    out += "\"sends\":" + std::to_string(stats.sends);
+    out += ",\"receives\":" + std::to_string(stats.receives);
+    out += ",\"send_blocked_ns\":" + std::to_string(stats.send_blocked.count());
+    out += ",\"receive_blocked_ns\":" + std::to_string(stats.receive_blocked.count());
+    out += ",\"high_water\":" + std::to_string(stats.high_water);
+    out += ",\"contended\":" + std::to_string(stats.contended);
+    out += "}";
+    return out;
+}
+
+QK_API std::string to_json(std::span<const goroutine_info> goroutines) {
+    auto now = std::chrono::steady_clock::now();
+    std::string out = "[";
+    for (size_t i = 0; i < goroutines.size(); i++) {
+        const goroutine_info& g = goroutines[i];
+        if (i > 0) out += ',';
+
+        out += "{\"id\":" + std::to_string(g.id);
+        out += ",\"state\":\"";
+        out += state_name(g.state);
+        out += "\",\"file\":";
+        append_json_string(out, g.site.file_name());
+        out += ",\"line\":" + std::to_string(g.site.line());
+        out += ",\"function\":";
+        append_json_string(out, g.site.function_name());
+        out += ",\"age_ns\":" + std::to_string((now - g.created) / std::chrono::nanoseconds(1));
+        out += "}";
+    }
+    out += "]";
+    return out;
+}
+
+}  // namespace qk::threading
+
+#endif
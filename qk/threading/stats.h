@@ -0,0 +1,177 @@
+#ifndef STATS_H
+#define STATS_H
+
+#ifdef QK_THREADING
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <source_location>
+#include <span>
+#include <string>
+#include <vector>
+#include "../api.h"
+
+namespace qk::threading {
+
+/// runtime counters of a single 'channel', returned by 'channel::stats'
+///
+/// the counters are only collected when qk is built with 'QK_THREADING_STATS', otherwise every
+/// field stays 0 and the channel carries no instrumentation at all
+struct channel_stats {
+    uint64_t sends = 0;
+    uint64_t receives = 0;
+
+    // total time senders spent blocked waiting for space (or a receiver on unbuffered channels)
+    std::chrono::nanoseconds send_blocked{0};
+
+    // total time receivers spent blocked waiting for a value
+    std::chrono::nanoseconds receive_blocked{0};
+
+    // the most values that were queued at once
+    size_t high_water = 0;
+
+    // operations that found the channels lock already taken
+    uint64_t contended = 0;
+};
+
+/// what a goroutine started with 'go' is currently doing
+enum class goroutine_state {
+    starting,
+    running,
+    sending,    // blocked in a channel send
+    receiving,  // blocked in a channel receive
+};
+
+/// a live goroutine, see 'goroutines'
+struct goroutine_info {
+    uint64_t id;
+    goroutine_state state;
+    std::source_location site;  // where 'go' was called
+    std::chrono::steady_clock::time_point created;
+};
+
+#ifdef QK_THREADING_STATS
+
+// every counter except 'contended' and the blocked times is only written with the channels lock
+// held, so they are bumped with a plain load and store instead of a locked read modify write
+struct _channel_counters {
+    std::atomic<uint64_t> sends = 0;
+    std::atomic<uint64_t> receives = 0;
+    std::atomic<int64_t> send_blocked_ns = 0;
+    std::atomic<int64_t> receive_blocked_ns = 0;
+    std::atomic<size_t> high_water = 0;
+    std::atomic<uint64_t> contended = 0;
+
+    static void _bump(std::atomic<uint64_t>& c) {
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void sent() { _bump(sends); }
+    void received() { _bump(receives); }
+
+    void queued(size_t size) {
+        if (size > high_water.load(std::memory_order_relaxed)) {
+            high_water.store(size, std::memory_order_relaxed);
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(std::mutex& mu) {
+        std::unique_lock l(mu, std::try_to_lock);
+        if (!l) {
+            contended.fetch_add(1, std::memory_order_relaxed);
+            l.lock();
+        }
+        return l;
+    }
+
+    channel_stats snapshot() const {
+        return {
+            sends.load(std::memory_order_relaxed),
+            receives.load(std::memory_order_relaxed),
+            std::chrono::nanoseconds(send_blocked_ns.load(std::memory_order_relaxed)),
+            std::chrono::nanoseconds(receive_blocked_ns.load(std::memory_order_relaxed)),
+            high_water.load(std::memory_order_relaxed),
+            contended.load(std::memory_order_relaxed),
+        };
+    }
+};
+
+// the registry entry of a goroutine, owned by its thread
+struct QK_API _goroutine_record {
+    uint64_t id = 0;
+    std::atomic<goroutine_state> state = goroutine_state::starting;
+    std::source_location site;
+    std::chrono::steady_clock::time_point created = std::chrono::steady_clock::now();
+
+    _goroutine_record* _prev = nullptr;
+    _goroutine_record* _next = nullptr;
+
+    explicit _goroutine_record(std::source_location s) : site(s) {}
+};
+
+QK_API void _track_goroutine(_goroutine_record* g);
+QK_API void _untrack_goroutine(_goroutine_record* g);
+
+// the record of the goroutine running on this thread, null on threads not started with 'go'
+inline _goroutine_record*& _current_goroutine() {
+    thread_local _goroutine_record* g = nullptr;
+    return g;
+}
+
+// times a blocking channel wait and shows it in the state of the current goroutine
+struct _blocked_scope {
+    _channel_counters& counters;
+    bool sending;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    _blocked_scope(_channel_counters& c, bool s) : counters(c), sending(s) {
+        if (auto g = _current_goroutine()) {
+            g->state = sending ? goroutine_state::sending : goroutine_state::receiving;
+        }
+    }
+
+    ~_blocked_scope() {
+        auto ns = (std::chrono::steady_clock::now() - start) / std::chrono::nanoseconds(1);
+        (sending ? counters.send_blocked_ns : counters.receive_blocked_ns)
+            .fetch_add(ns, std::memory_order_relaxed);
+        if (auto g = _current_goroutine()) g->state = goroutine_state::running;
+    }
+
+    _blocked_scope(const _blocked_scope&) = delete;
+    _blocked_scope& operator=(const _blocked_scope&) = delete;
+};
+
+#else
+
+// compiles down to nothing when instrumentation is disabled
+struct _channel_counters {
+    void sent() {}
+    void received() {}
+    void queued(size_t) {}
+    std::unique_lock<std::mutex> lock(std::mutex& mu) { return std::unique_lock(mu); }
+    channel_stats snapshot() const { return {}; }
+};
+
+struct _blocked_scope {
+    _blocked_scope(_channel_counters&, bool) {}
+};
+
+#endif
+
+/// returns every goroutine started with 'go' that is still running, always empty unless qk is
+/// built with 'QK_THREADING_STATS'
+QK_API std::vector<goroutine_info> goroutines();
+
+/// serializes channel counters as a json object, durations are in nanoseconds
+QK_API std::string to_json(const channel_stats& stats);
+
+/// serializes a 'goroutines' snapshot as a json array
+QK_API std::string to_json(std::span<const goroutine_info> goroutines);
+
+}  // namespace qk::threading
+
+#endif
+
+#endif  // STATS_H
@@ -0,0 +1,74 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#ifdef QK_THREADING
+
+#include <cstddef>
+#include <thread>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+#include <intrin.h>
+#endif
+
+namespace qk::threading {
+
+/// size used to pad hot atomics onto separate cache lines,
+/// 'std::hardware_destructive_interference_size' is not used since it triggers abi warnings on gcc
+/// and is missing on some standard libraries
+inline constexpr size_t cache_line_size = 64;
+
+/// hints the cpu that the current thread is spinning, used inside busy wait loops to save power
+/// and let the sibling hyperthread make progress
+inline void cpu_relax() noexcept {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_pause();
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+    __yield();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+/// true when the machine has more than one hardware thread, busy spinning is pointless otherwise
+/// since the thread we are waiting on can not run while we spin
+inline const bool can_spin = std::thread::hardware_concurrency() > 1;
+
+/// how long a waiting thread polls before it goes to sleep, 'spins' busy iterations with
+/// 'cpu_relax' followed by 'yields' calls to 'std::this_thread::yield'
+///
+/// spinning saves the kernel round trip when the wait ends within a few microseconds but burns cpu
+/// when it does not, '{0, 0}' parks right away
+struct spin_budget {
+    int spins = 64;
+    int yields = 4;
+};
+
+/// evaluates 'ready' until it returns true, first busy spinning 'spins' times and then yielding the
+/// thread 'yields' times, returns false if the budget ran out and the caller should park instead
+///
+/// the busy spinning phase is skipped on single core machines
+template <typename Ready>
+bool spin_until(Ready&& ready, int spins, int yields) {
+    if (!can_spin) spins = 0;
+    for (int i = 0; i < spins; i++) {
+        if (ready()) return true;
+        cpu_relax();
+    }
+    for (int i = 0; i < yields; i++) {
+        if (ready()) return true;
+        std::this_thread::yield();
+    }
+    return ready();
+}
+
+}  // namespace qk::threading
+
+#endif
+
+#endif  // SYNC_H
@@ -0,0 +1,222 @@
+#include "timer.h"
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifdef QK_THREADING
+
+namespace qk::threading {
+
+using timer_clock = std::chrono::steady_clock;
+
+// 4 levels of 256 slots at 1ms per tick cover about 49 days, timers further out are parked in the
+// last level and cascade down once they come into range
+static constexpr int wheel_bits = 8;
+static constexpr uint64_t wheel_slots = 1 << wheel_bits;
+static constexpr uint64_t wheel_mask = wheel_slots - 1;
+static constexpr int wheel_levels = 4;
+static constexpr uint64_t wheel_span = uint64_t(1) << (wheel_bits * wheel_levels);
+
+struct _timer_list {
+    timer* head = nullptr;
+};
+
+static void link(_timer_list* list, timer* t) {
+    t->_list = list;
+    t->_prev = nullptr;
+    t->_next = list->head;
+    if (list->head) list->head->_prev = t;
+    list->head = t;
+}
+
+static void unlink(timer* t) {
+    if (t->_prev)
+        t->_prev->_next = t->_next;
+    else
+        t->_list->head = t->_next;
+    if (t->_next) t->_next->_prev = t->_prev;
+    t->_list = nullptr;
+    t->_prev = t->_next = nullptr;
+}
+
+struct timer_wheel {
+    std::mutex mu;
+    std::condition_variable wake;
+    std::array<std::array<_timer_list, wheel_slots>, wheel_levels> slots{};
+
+    timer_clock::time_point epoch = timer_clock::now();
+    uint64_t now = 0;  // last tick that was processed
+    uint64_t next_wake = UINT64_MAX;
+    size_t pending = 0;
+    bool stopping = false;
+
+    std::jthread thread;
+
+    timer_wheel() {
+        thread = std::jthread([this] { run(); });
+    }
+
+    ~timer_wheel() {
+        {
+            std::lock_guard l(mu);
+            stopping = true;
+        }
+        wake.notify_one();
+    }
+
+    uint64_t tick_now() const {
+        auto elapsed = std::chrono::floor<std::chrono::milliseconds>(timer_clock::now() - epoch);
+        return uint64_t(elapsed.count());
+    }
+
+    // rounds up so timers never fire early
+    uint64_t tick_after(timer_clock::duration timeout) const {
+        auto at = timer_clock::now() - epoch + std::max(timeout, timer_clock::duration::zero());
+        auto ticks = std::chrono::ceil<std::chrono::milliseconds>(at).count();
+        return std::max<uint64_t>(uint64_t(ticks), 1);
+    }
+
+    // files 't' into the slot of the lowest level that can tell its expiry apart from 'now', O(1),
+    // 'earliest' keeps timers out of slots the wheel already went past
+    void place(timer* t, uint64_t earliest) {
+        uint64_t expires = std::max(t->_expires, earliest);
+        uint64_t delta = std::min(expires - now, wheel_span - 1);
+
+        int level = 0;
+        while (delta >= uint64_t(1) << (wheel_bits * (level + 1))) {
+            level++;
+        }
+        uint64_t placed = now + delta;
+        link(&slots[level][(placed >> (wheel_bits * level)) & wheel_mask], t);
+    }
+
+    void insert(timer* t) {
+        // an idle wheel does not advance, catch up before placing relative to 'now'
+        if (pending == 0) now = std::max(now, tick_now());
+
+        place(t, now + 1);
+        pending++;
+        if (t->_expires < next_wake) wake.notify_one();
+    }
+
+    void remove(timer* t) {
+        unlink(t);
+        pending--;
+    }
+
+    void run_tick(uint64_t tick, timer_clock::time_point at) {
+        // refile the timers of every higher level slot that comes into range at this tick, higher
+        // levels first since they can refile into lower level slots due at the same tick
+        for (int level = wheel_levels - 1; level > 0; level--) {
+            if ((tick & ((uint64_t(1) << (wheel_bits * level)) - 1)) != 0) continue;
+
+            _timer_list& list = slots[level][(tick >> (wheel_bits * level)) & wheel_mask];
+            while (list.head) {
+                timer* t = list.head;
+                unlink(t);
+                place(t, tick);
+            }
+        }
+
+        _timer_list& due = slots[0][tick & wheel_mask];
+        while (due.head) {
+            timer* t = due.head;
+            unlink(t);
+            t->try_send(at);
+
+            if (t->_period > 0) {
+                t->_expires += t->_period;
+                place(t, tick + 1);
+            } else {
+                pending--;
+            }
+        }
+    }
+
+    // the next tick worth waking up for, either a non empty first level slot or the next cascade
+    uint64_t next_tick() const {
+        uint64_t tick = now + 1;
+        while ((tick & wheel_mask) != 0 && !slots[0][tick & wheel_mask].head) {
+            tick++;
+        }
+        return tick;
+    }
+
+    void run() {
+        std::unique_lock l(mu);
+        while (!stopping) {
+            uint64_t current = tick_now();
+            if (now < current) {
+                auto at = timer_clock::now();
+                while (now < current) {
+                    now++;
+                    run_tick(now, at);
+                }
+            }
+
+            if (pending == 0) {
+                next_wake = UINT64_MAX;
+                wake.wait(l, [this] { return stopping || pending > 0; });
+                continue;
+            }
+
+            next_wake = next_tick();
+            wake.wait_until(l, epoch + std::chrono::milliseconds(next_wake));
+        }
+    }
+};
+
+static timer_wheel& wheel() {
+    static timer_wheel w;
+    return w;
+}
+
+timer::~timer() { stop(); }
+
+bool timer::stop() {
+    timer_wheel& w = wheel();
+    std::lock_guard l(w.mu);
+    if (!_list) return false;
+
+    w.remove(this);
+    return true;
+}
+
+bool timer::reset(std::chrono::steady_clock::duration timeout) {
+    timer_wheel& w = wheel();
+    std::lock_guard l(w.mu);
+    bool was_pending = _list != nullptr;
+    if (was_pending) w.remove(this);
+
+    _expires = w.tick_after(timeout);
+    w.insert(this);
+    return was_pending;
+}
+
+QK_API std::unique_ptr<timer> after(std::chrono::steady_clock::duration timeout) {
+    auto t = std::make_unique<timer>();
+    t->reset(timeout);
+    return t;
+}
+
+QK_API std::unique_ptr<timer> ticker(std::chrono::steady_clock::duration period) {
+    auto t = std::make_unique<timer>();
+    t->_period = std::max<uint64_t>(
+        1, uint64_t(std::chrono::ceil<std::chrono::milliseconds>(period).count())
+    );
+    t->reset(period);
+    return t;
+}
+
+QK_API size_t pending_timers() {
+    timer_wheel& w = wheel();
+    std::lock_guard l(w.mu);
+    return w.pending;
+}
+
+}  // namespace qk::threading
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#ifdef QK_THREADING
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include "../api.h"
+#include "gorutines.h"
+
+namespace qk::threading {
+
+/// granularity of the timer wheel, timers never fire early but may fire up to one resolution late
+inline constexpr std::chrono::milliseconds timer_resolution{1};
+
+struct _timer_list;
+
+/// a channel that receives the current time once a deadline passes, and again every period for
+/// tickers, created with 'after' and 'ticker'
+///
+/// every timer in the process is driven by a single hierarchical timer wheel thread, so pending
+/// timers cost a few pointers each instead of a thread, inserting and stopping a timer is O(1)
+///
+/// the channel has a capacity of 1, a ticker whose receiver falls behind drops ticks instead of
+/// queueing them, like in go
+///
+/// destroying a timer stops it, so it is safe to let a timer that did not fire go out of scope
+struct QK_API timer : channel<std::chrono::steady_clock::time_point> {
+    // wheel bookkeeping, only touched with the wheels lock held
+    uint64_t _expires = 0;
+    uint64_t _period = 0;
+    _timer_list* _list = nullptr;
+    timer* _prev = nullptr;
+    timer* _next = nullptr;
+
+    timer() : channel(1) {}
+    ~timer();
+
+    timer(const timer&) = delete;
+    timer& operator=(const timer&) = delete;
+    timer(timer&&) = delete;
+    timer& operator=(timer&&) = delete;
+
+    /// stops the timer, returns false if it already fired (one shot timers) or was stopped, a value
+    /// that was already delivered stays in the channel
+    bool stop();
+
+    /// stops the timer and arms it again to fire after 'timeout', tickers keep their period,
+    /// returns whether the timer was still pending
+    bool reset(std::chrono::steady_clock::duration timeout);
+};
+
+/// returns a timer that receives the time once after 'timeout', the go 'time.After' equivalent
+///
+///     @code
+///     auto timeout = after(std::chrono::seconds(5));
+///     select(
+///         case_recv(responses, [](std::optional<response> r) { ... }),
+///         case_recv(*timeout, [] { ... })
+///     );
+///     @endcode
+QK_API std::unique_ptr<timer> after(std::chrono::steady_clock::duration timeout);
+
+/// returns a timer that receives the time every 'period' until it is stopped, the go
+/// 'time.NewTicker' equivalent
+QK_API std::unique_ptr<timer> ticker(std::chrono::steady_clock::duration period);
+
+/// number of timers currently armed in the timer wheel
+QK_API size_t pending_timers();
+
+}  // namespace qk::threading
+
+#endif
+
+#endif  // TIMER_H
@@ -1,5 +1,12 @@
 #include <qk/qk_events.h>
 #include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
 
 using namespace qk::events;
 
@@ -10,8 +17,8 @@ TEST_CASE("EventBus subscription and publishing", "[events]") {
         bool event_triggered = false;
         auto callback = [&event_triggered](void* event) { event_triggered = true; };
 
-        int id = subscribe<int>(callback, &bus);
-        REQUIRE(id > 0);
+        subscription id = subscribe<int>(callback, &bus);
+        REQUIRE(id != subscription{});
 
         publish(42, &bus);
         REQUIRE(event_triggered);
@@ -21,7 +28,7 @@ TEST_CASE("EventBus subscription and publishing", "[events]") {
         bool event_triggered = false;
         auto callback = [&event_triggered](void* event) { event_triggered = true; };
 
-        int id = subscribe<int>(callback, &bus);
+        subscription id = subscribe<int>(callback, &bus);
         unsubscribe(id, &bus);
 
         publish(42, &bus);
@@ -61,4 +68,421 @@ TEST_CASE("EventBus subscription and publishing", "[events]") {
         publish(42, &bus);
         REQUIRE(trigger_count == 2);
     }
-}
\ No newline at end of file
+}
+TEST_CASE("EventBus reentrancy and concurrent publishing", "[events]") {
+    EventBus bus;
+
+    SECTION("Callbacks can publish, subscribe and unsubscribe") {
+        int ints = 0;
+        int floats = 0;
+        int late = 0;
+        subscription self_id;
+
+        subscribe<float>([&](void*) { floats++; }, &bus);
+        self_id = subscribe<int>(
+            [&](void* event) {
+                ints++;
+                publish(float(*static_cast<int*>(event)), &bus);
+                subscribe<int>([&](void*) { late++; }, &bus);
+                unsubscribe(self_id, &bus);
+            },
+            &bus
+        );
+
+        publish(1, &bus);
+        REQUIRE(ints == 1);
+        REQUIRE(floats == 1);
+        REQUIRE(late == 0);  // subscribed during the publish, so only sees the next one
+
+        publish(2, &bus);
+        REQUIRE(ints == 1);
+        REQUIRE(late == 1);
+    }
+
+    SECTION("Publishing from many threads while subscribers change") {
+        std::atomic_int received = 0;
+        subscribe<int>([&](void*) { received++; }, &bus);
+
+        std::atomic_bool stop = false;
+        std::thread churn([&] {
+            while (!stop) {
+                subscription id = subscribe<int>([](void*) {}, &bus);
+                unsubscribe(id, &bus);
+            }
+        });
+
+        std::vector<std::thread> publishers;
+        for (int t = 0; t < 4; t++) {
+            publishers.emplace_back([&] {
+                for (int i = 0; i < 2000; i++) {
+                    publish(i, &bus);
+                }
+            });
+        }
+        for (auto& p : publishers) {
+            p.join();
+        }
+        stop = true;
+        churn.join();
+
+        REQUIRE(received == 8000);
+    }
+
+    SECTION("Replaced snapshots only wait for older publishes") {
+        std::array<std::atomic_bool, 2> entered{};
+        std::array<std::atomic_bool, 2> release{};
+        subscribe<int>(
+            [&](const int& i) {
+                entered[i] = true;
+                while (!release[i]) std::this_thread::yield();
+            },
+            &bus
+        );
+        auto retired = [&] {
+            std::lock_guard l(bus.mu);
+            return bus._retired.size();
+        };
+
+        std::thread first([&] { publish(0, &bus); });
+        while (!entered[0]) std::this_thread::yield();
+
+        // every snapshot replaced while the first publish runs is kept for it
+        for (int i = 0; i < 5; i++) {
+            subscribe<float>([](const float&) {}, &bus);
+        }
+        REQUIRE(retired() == 5);
+
+        std::thread second([&] { publish(1, &bus); });
+        while (!entered[1]) std::this_thread::yield();
+        release[0] = true;
+        first.join();
+
+        // the second publish started after those replacements, so it only holds back the next one
+        subscribe<float>([](const float&) {}, &bus);
+        REQUIRE(retired() == 1);
+
+        release[1] = true;
+        second.join();
+        subscribe<float>([](const float&) {}, &bus);
+        REQUIRE(retired() == 0);
+    }
+}
+
+template <int N>
+struct indexed_event {
+    int v;
+};
+
+template <int... N>
+void subscribe_each(std::atomic_int& received, EventBus* bus, std::integer_sequence<int, N...>) {
+    (subscribe<indexed_event<N>>([&](void*) { received++; }, bus), ...);
+}
+
+template <int... N>
+void publish_each(EventBus* bus, std::integer_sequence<int, N...>) {
+    (publish(indexed_event<N>{N}, bus), ...);
+}
+
+TEST_CASE("EventBus dense event indices", "[events]") {
+    EventBus bus;
+
+    SECTION("Indices are stable and distinct per type") {
+        REQUIRE(event_index<indexed_event<0>>() == event_index<indexed_event<0>>());
+        REQUIRE(event_index<indexed_event<0>>() != event_index<indexed_event<1>>());
+        REQUIRE(event_index<int>() != event_index<float>());
+    }
+
+    SECTION("Publishing without subscribers does nothing") {
+        int received = 0;
+        publish(indexed_event<0>{1}, &bus);
+
+        subscription id = subscribe<indexed_event<0>>([&](void*) { received++; }, &bus);
+        publish(indexed_event<0>{1}, &bus);
+        unsubscribe(id, &bus);
+        publish(indexed_event<0>{1}, &bus);
+
+        REQUIRE(received == 1);
+    }
+
+    SECTION("Many event types on one bus") {
+        std::atomic_int received = 0;
+        auto types = std::make_integer_sequence<int, 200>();
+        subscribe_each(received, &bus, types);
+        publish_each(&bus, types);
+        REQUIRE(received == 200);
+
+        remove_event<indexed_event<42>>(&bus);
+        publish_each(&bus, types);
+        REQUIRE(received == 399);
+
+        unsubscribe_all(&bus);
+        publish_each(&bus, types);
+        REQUIRE(received == 399);
+    }
+}
+
+struct counted_event {
+    static inline int copies = 0;
+    std::vector<int> payload;
+
+    counted_event(size_t n) : payload(n, 1) {}
+    counted_event(const counted_event& other) : payload(other.payload) { copies++; }
+    counted_event(counted_event&&) = default;
+};
+
+struct resize_listener {
+    int width = 0;
+    void on_resize(const int& w) { width = w; }
+};
+
+TEST_CASE("EventBus typed handlers", "[events]") {
+    EventBus bus;
+
+    SECTION("Handlers receive the event by reference") {
+        counted_event::copies = 0;
+        size_t seen = 0;
+        subscribe<counted_event>([&](const counted_event& e) { seen += e.payload.size(); }, &bus);
+        subscribe<counted_event>([&](const counted_event& e) { seen += e.payload.size(); }, &bus);
+
+        counted_event big(1000);
+        publish(big, &bus);
+        publish(counted_event(10), &bus);
+
+        REQUIRE(seen == 2020);
+        REQUIRE(counted_event::copies == 0);
+    }
+
+    SECTION("Member functions") {
+        resize_listener listener;
+        subscription id = subscribe(&resize_listener::on_resize, &listener, &bus);
+
+        publish(640, &bus);
+        REQUIRE(listener.width == 640);
+
+        unsubscribe(id, &bus);
+        publish(800, &bus);
+        REQUIRE(listener.width == 640);
+    }
+
+    SECTION("Small handlers are stored inline") {
+        resize_listener listener;
+        auto captureless = event_handler::make<int>([](const int&) {});
+        auto bound = event_handler::make<int>([l = &listener](const int& w) { l->on_resize(w); });
+        REQUIRE(captureless._manage == nullptr);
+        REQUIRE(bound._manage == nullptr);
+
+        auto copy = bound;
+        int w = 3;
+        copy(&w);
+        REQUIRE(listener.width == 3);
+    }
+
+    SECTION("Large handlers are copied and moved with the subscriber lists") {
+        std::array<int, 32> big{};
+        big[31] = 7;
+        int sum = 0;
+        subscription id =
+            subscribe<int>([&sum, big](const int& v) { sum += v + big[31]; }, &bus);
+
+        // every subscription copies the list the handler is in
+        for (int i = 0; i < 10; i++) {
+            subscribe<int>([](const int&) {}, &bus);
+        }
+        publish(1, &bus);
+        unsubscribe(id, &bus);
+        publish(1, &bus);
+
+        REQUIRE(sum == 8);
+    }
+}
+
+TEST_CASE("EventBus deferred queue", "[events]") {
+    EventBus bus;
+
+    SECTION("Events are delivered on flush in order") {
+        std::vector<int> received;
+        subscribe<int>([&](const int& v) { received.push_back(v); }, &bus);
+
+        for (int i = 0; i < 5; i++) {
+            enqueue(i, &bus);
+        }
+        REQUIRE(received.empty());
+
+        flush(&bus);
+        REQUIRE(received == std::vector<int>{0, 1, 2, 3, 4});
+
+        flush(&bus);
+        REQUIRE(received.size() == 5);
+    }
+
+    SECTION("Each type is dispatched as one batch") {
+        std::vector<int> order;
+        subscribe<int>([&](const int&) { order.push_back(0); }, &bus);
+        subscribe<float>([&](const float&) { order.push_back(1); }, &bus);
+
+        enqueue(1, &bus);
+        enqueue(1.0f, &bus);
+        enqueue(2, &bus);
+        enqueue(2.0f, &bus);
+        flush(&bus);
+
+        REQUIRE(order.size() == 4);
+        REQUIRE(order[0] == order[1]);
+        REQUIRE(order[2] == order[3]);
+        REQUIRE(order[0] != order[2]);
+    }
+
+    SECTION("Events queued by handlers wait for the next flush") {
+        int received = 0;
+        subscribe<int>(
+            [&](const int& v) {
+                received++;
+                if (v > 0) enqueue(v - 1, &bus);
+            },
+            &bus
+        );
+
+        enqueue(2, &bus);
+        flush(&bus);
+        REQUIRE(received == 1);
+        flush(&bus);
+        flush(&bus);
+        REQUIRE(received == 3);
+        flush(&bus);
+        REQUIRE(received == 3);
+    }
+
+    SECTION("Producer threads are merged on flush") {
+        std::atomic_int sum = 0;
+        std::vector<std::vector<int>> seen(4);
+        subscribe<std::pair<int, int>>(
+            [&](const std::pair<int, int>& e) {
+                seen[e.first].push_back(e.second);
+                sum += e.second;
+            },
+            &bus
+        );
+
+        std::vector<std::thread> producers;
+        for (int t = 0; t < 4; t++) {
+            producers.emplace_back([&, t] {
+                for (int i = 0; i < 1000; i++) {
+                    enqueue(std::pair{t, i}, &bus);
+                }
+            });
+        }
+        for (auto& p : producers) {
+            p.join();
+        }
+
+        // the producers exited, their queued events are still delivered
+        flush(&bus);
+        REQUIRE(sum == 4 * (999 * 1000 / 2));
+        for (auto& s : seen) {
+            REQUIRE(std::ranges::is_sorted(s));
+            REQUIRE(s.size() == 1000);
+        }
+        REQUIRE(bus._queues.empty());
+    }
+}
+
+TEST_CASE("EventBus subscription handles", "[events]") {
+    EventBus bus;
+
+    SECTION("Stale handles do not hit a newer subscriber") {
+        int first = 0;
+        int second = 0;
+        subscription a = subscribe<int>([&](const int&) { first++; }, &bus);
+        unsubscribe(a, &bus);
+
+        // reuses the slot of 'a' with a new generation
+        subscription b = subscribe<int>([&](const int&) { second++; }, &bus);
+        REQUIRE(b.slot == a.slot);
+        REQUIRE(b != a);
+
+        unsubscribe(a, &bus);
+        publish(1, &bus);
+        REQUIRE(first == 0);
+        REQUIRE(second == 1);
+    }
+
+    SECTION("Unsubscribing from the middle keeps the others") {
+        std::vector<int> seen;
+        std::vector<subscription> subs;
+        for (int i = 0; i < 5; i++) {
+            subs.push_back(subscribe<int>([&seen, i](const int&) { seen.push_back(i); }, &bus));
+        }
+
+        unsubscribe(subs[1], &bus);
+        unsubscribe(subs[3], &bus);
+        publish(1, &bus);
+        REQUIRE(seen == std::vector<int>{0, 2, 4});
+
+        // subscribing compacts the list, the moved subscribers can still be removed by their handle
+        seen.clear();
+        subs.push_back(subscribe<int>([&seen](const int&) { seen.push_back(5); }, &bus));
+        unsubscribe(subs[2], &bus);
+        publish(1, &bus);
+        REQUIRE(seen == std::vector<int>{0, 4, 5});
+    }
+
+    SECTION("Handler captures may unsubscribe when destroyed") {
+        struct unsubscribe_on_destroy {
+            subscription sub;
+            EventBus* bus;
+            ~unsubscribe_on_destroy() { unsubscribe(sub, bus); }
+        };
+
+        int received = 0;
+        subscription other = subscribe<float>([&](const float&) { received++; }, &bus);
+        auto guard = std::make_shared<unsubscribe_on_destroy>(other, &bus);
+        subscription a = subscribe<int>([guard](const int&) {}, &bus);
+        guard.reset();
+
+        // subscribing compacts the list of 'a' away, freeing the last copy of its handler runs
+        // the unsubscribe above, which has to happen after the bus was unlocked
+        unsubscribe(a, &bus);
+        subscribe<int>([](const int&) {}, &bus);
+
+        publish(1.0f, &bus);
+        REQUIRE(received == 0);
+    }
+
+    SECTION("Removed subscribers are compacted in batches") {
+        int received = 0;
+        std::vector<subscription> subs;
+        for (int i = 0; i < 100; i++) {
+            subs.push_back(subscribe<int>([&](const int&) { received++; }, &bus));
+        }
+
+        for (int i = 0; i < 99; i++) {
+            unsubscribe(subs[i], &bus);
+        }
+        REQUIRE(bus._removed <= bus._live + bus._counts.size());
+
+        publish(1, &bus);
+        REQUIRE(received == 1);
+
+        unsubscribe(subs[99], &bus);
+        publish(1, &bus);
+        REQUIRE(received == 1);
+        REQUIRE(bus._live == 0);
+    }
+
+    SECTION("Handles are invalidated by remove_event and unsubscribe_all") {
+        int received = 0;
+        subscription a = subscribe<int>([&](const int&) { received++; }, &bus);
+        remove_event<int>(&bus);
+        subscription b = subscribe<float>([&](const float&) { received++; }, &bus);
+        unsubscribe_all(&bus);
+
+        subscribe<int>([&](const int&) { received++; }, &bus);
+        subscribe<float>([&](const float&) { received++; }, &bus);
+        unsubscribe(a, &bus);
+        unsubscribe(b, &bus);
+
+        publish(1, &bus);
+        publish(1.0f, &bus);
+        REQUIRE(received == 2);
+    }
+}
@@ -1,10 +1,99 @@
 #include <qk/qk_threading.h>
 #include <catch2/catch_test_macros.hpp>
+#include <array>
 #include <chrono>
+#include <cstdlib>
+#include <latch>
+#include <new>
+#include <numeric>
+#include <print>
+#include <ranges>
+#include <string>
 #include <thread>
+#include <vector>
 
 using namespace qk::threading;
 
+#ifdef QK_UTILS
+#include <qk/qk_utils.h>
+#endif
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// heap allocations made by the current thread, used to check that hot paths stay allocation free
+//
+// every form of the global operator new and delete is replaced, the test binary is shared with the
+// other modules and memory from any form has to be released by the matching one
+static thread_local size_t thread_allocations = 0;
+
+constexpr size_t default_new_align = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+static void* counted_alloc(size_t size, size_t align = default_new_align) noexcept {
+    thread_allocations++;
+    size = size ? size : 1;
+    if (align <= default_new_align) return std::malloc(size);
+#ifdef _WIN32
+    return _aligned_malloc(size, align);
+#else
+    return std::aligned_alloc(align, (size + align - 1) / align * align);
+#endif
+}
+
+// kept out of line, once 'free' is inlined into 'operator delete' gcc sees it release memory from
+// 'operator new' and warns about a mismatch
+#ifdef __GNUC__
+[[gnu::noinline]]
+#endif
+static void counted_free(void* p, size_t align = default_new_align) noexcept {
+#ifdef _WIN32
+    if (align > default_new_align) return _aligned_free(p);
+#else
+    (void)align;
+#endif
+    std::free(p);
+}
+
+static void* counted_new(size_t size, size_t align = default_new_align) {
+    if (void* p = counted_alloc(size, align)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size) { return counted_new(size); }
+void* operator new[](size_t size) { return counted_new(size); }
+void* operator new(size_t size, std::align_val_t al) { return counted_new(size, size_t(al)); }
+void* operator new[](size_t size, std::align_val_t al) { return counted_new(size, size_t(al)); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+void* operator new(size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return counted_alloc(size, size_t(al));
+}
+void* operator new[](size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return counted_alloc(size, size_t(al));
+}
+
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, size_t) noexcept { counted_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+
+void operator delete(void* p, std::align_val_t al) noexcept { counted_free(p, size_t(al)); }
+void operator delete[](void* p, std::align_val_t al) noexcept { counted_free(p, size_t(al)); }
+void operator delete(void* p, size_t, std::align_val_t al) noexcept { counted_free(p, size_t(al)); }
+void operator delete[](void* p, size_t, std::align_val_t al) noexcept {
+    counted_free(p, size_t(al));
+}
+void operator delete(void* p, std::align_val_t al, const std::nothrow_t&) noexcept {
+    counted_free(p, size_t(al));
+}
+void operator delete[](void* p, std::align_val_t al, const std::nothrow_t&) noexcept {
+    counted_free(p, size_t(al));
+}
+
 TEST_CASE("Goroutine execution", "[threading]") {
     SECTION("Simple goroutine") {
         bool executed = false;
@@ -72,4 +161,1545 @@ TEST_CASE("Channel communication", "[threading]") {
 
         REQUIRE(results == std::vector<int>({1, 2, 3}));
     }
-}
\ No newline at end of file
+}
+TEST_CASE("Thread pool", "[threading]") {
+    SECTION("Tasks run on the pool") {
+        thread_pool pool(4);
+        REQUIRE(worker_count(&pool) == 4);
+
+        std::atomic_int count = 0;
+        std::latch done(256);
+        for (int i = 0; i < 256; i++) {
+            REQUIRE(go_on(&pool, [&] {
+                ++count;
+                done.count_down();
+            }));
+        }
+
+        done.wait();
+        REQUIRE(count == 256);
+    }
+
+    SECTION("Tasks spawned from workers") {
+        thread_pool pool(2);
+        std::atomic_int count = 0;
+        std::latch done(64);
+
+        for (int i = 0; i < 8; i++) {
+            go_on(&pool, [&] {
+                for (int j = 0; j < 8; j++) {
+                    go_on(&pool, [&] {
+                        ++count;
+                        done.count_down();
+                    });
+                }
+            });
+        }
+
+        done.wait();
+        REQUIRE(count == 64);
+    }
+
+    SECTION("Shutdown drains queued tasks") {
+        std::atomic_int count = 0;
+        thread_pool pool(1);
+
+        for (int i = 0; i < 100; i++) {
+            go_on(&pool, [&] {
+                sleep_ms(1);
+                ++count;
+            });
+        }
+
+        shutdown(&pool);
+        REQUIRE(count == 100);
+        REQUIRE_FALSE(go_on(&pool, [] {}));
+    }
+}
+
+TEST_CASE("SPSC channel", "[threading]") {
+    SECTION("Capacity is rounded to a power of two") {
+        spsc_channel<int> ch(5);
+        REQUIRE(ch.capacity() == 8);
+    }
+
+    SECTION("Values arrive in order") {
+        spsc_channel<int> ch(4);
+        std::jthread producer([&ch] {
+            for (int i = 0; i < 1000; i++) {
+                ch << i;
+            }
+            ch.close();
+        });
+
+        int expected = 0;
+        for (auto val : ch) {
+            REQUIRE(val == expected);
+            expected++;
+        }
+        REQUIRE(expected == 1000);
+    }
+
+    SECTION("Closed channel drains before failing") {
+        spsc_channel<std::string> ch(2);
+        ch << std::string("a");
+        ch.close();
+
+        REQUIRE_FALSE(ch.send("b"));
+        REQUIRE(ch.is_closed());
+        REQUIRE(~ch == "a");
+        REQUIRE_FALSE((~ch).has_value());
+    }
+}
+
+TEST_CASE("MPMC channel", "[threading]") {
+    SECTION("Many producers and consumers") {
+        mpmc_channel<int> ch(8);
+        std::atomic_long sum = 0;
+        std::atomic_int received = 0;
+
+        {
+            std::vector<std::jthread> consumers;
+            for (int c = 0; c < 4; c++) {
+                consumers.emplace_back([&] {
+                    for (auto val : ch) {
+                        sum += val;
+                        ++received;
+                    }
+                });
+            }
+
+            std::vector<std::jthread> producers;
+            for (int p = 0; p < 4; p++) {
+                producers.emplace_back([&] {
+                    for (int i = 1; i <= 1000; i++) {
+                        ch << i;
+                    }
+                });
+            }
+
+            for (auto& p : producers) p.join();
+            ch.close();
+        }
+
+        REQUIRE(received == 4000);
+        REQUIRE(sum == 4 * 500500);
+    }
+
+    SECTION("Closed channel drains before failing") {
+        mpmc_channel<int> ch(4);
+        ch << 1 << 2;
+        ch.close();
+
+        REQUIRE_FALSE(ch.send(3));
+        REQUIRE(ch.is_closed());
+        REQUIRE(~ch == 1);
+        REQUIRE(~ch == 2);
+        REQUIRE_FALSE((~ch).has_value());
+    }
+}
+
+TEST_CASE("Select", "[threading]") {
+    SECTION("Picks the ready channel") {
+        int_channel a(1), b(1);
+        b << 7;
+
+        int got = 0;
+        size_t index = select(
+            case_recv(a, [&](std::optional<int> v) { got = -1; }),
+            case_recv(b, [&](std::optional<int> v) { got = *v; })
+        );
+
+        REQUIRE(index == 1);
+        REQUIRE(got == 7);
+    }
+
+    SECTION("Default case does not block") {
+        int_channel a(1);
+        bool defaulted = false;
+
+        size_t index = select(case_recv(a, [] {}), default_case([&] { defaulted = true; }));
+        REQUIRE(index == 1);
+        REQUIRE(defaulted);
+    }
+
+    SECTION("Send case") {
+        int_channel a(1);
+        bool sent = false;
+
+        select(case_send(a, 42, [&] { sent = true; }), default_case([] {}));
+        REQUIRE(sent);
+        REQUIRE(~a == 42);
+    }
+
+    SECTION("Timeout case") {
+        int_channel a;
+        bool timed_out = false;
+
+        auto start = std::chrono::steady_clock::now();
+        select(
+            case_recv(a, [] {}),
+            timeout_case(std::chrono::milliseconds(20), [&] { timed_out = true; })
+        );
+
+        REQUIRE(timed_out);
+        REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+    }
+
+    SECTION("Wakes on a send from another thread") {
+        int_channel a(1), b;
+        int got = 0;
+
+        std::jthread sender([&] {
+            sleep_ms(10);
+            b << 5;
+        });
+
+        select(case_recv(a, [] {}), case_recv(b, [&](std::optional<int> v) { got = *v; }));
+        REQUIRE(got == 5);
+    }
+
+    SECTION("Closed channel is ready") {
+        int_channel a(1);
+        a.close();
+
+        bool closed = false;
+        select(case_recv(a, [&](std::optional<int> v) { closed = !v; }));
+        REQUIRE(closed);
+    }
+
+    SECTION("Losing cases leave their channels alone") {
+        int_channel a, b;
+        int got = 0;
+
+        std::jthread selector([&] {
+            select(case_recv(a, [] {}), case_recv(b, [&](std::optional<int> v) { got = *v; }));
+        });
+        while (true) {
+            std::lock_guard l(a._mu);
+            if (a._parked_receivers.count == 1) break;
+        }
+
+        b << 5;
+        selector.join();
+
+        REQUIRE(got == 5);
+        REQUIRE_FALSE(a.try_send(1));
+        REQUIRE(a._parked_receivers.count == 0);
+        REQUIRE(a.empty());
+    }
+
+    SECTION("Selects hand values to each other") {
+        int_channel ch;
+        std::jthread sender([&] { select(case_send(ch, 9, [] {})); });
+
+        int got = 0;
+        select(case_recv(ch, [&](std::optional<int> v) { got = *v; }));
+        REQUIRE(got == 9);
+    }
+
+    SECTION("Every value reaches exactly one select") {
+        constexpr int n = 2000;
+        int_channel a, b;
+        std::jthread send_a([&] {
+            for (int i = 1; i <= n; i++) a << i;
+        });
+        std::jthread send_b([&] {
+            for (int i = 1; i <= n; i++) b << -i;
+        });
+
+        int received = 0;
+        long long sum = 0;
+        auto add = [&](std::optional<int> v) {
+            received++;
+            sum += *v;
+        };
+        for (int i = 0; i < 2 * n; i++) {
+            select(case_recv(a, add), case_recv(b, add));
+        }
+
+        REQUIRE(received == 2 * n);
+        REQUIRE(sum == 0);
+    }
+}
+
+TEST_CASE("Channel batching", "[threading]") {
+    SECTION("send_n moves as many values as fit") {
+        int_channel ch(4);
+        std::vector<int> vals = {1, 2, 3, 4, 5, 6};
+
+        REQUIRE(ch.send_n(vals) == 4);
+
+        std::vector<int> out(8);
+        REQUIRE(ch.receive_n(out, 3) == 3);
+        REQUIRE(out[0] == 1);
+        REQUIRE(out[2] == 3);
+
+        REQUIRE(ch.send_n(std::span(vals).subspan(4)) == 2);
+
+        std::vector<int> rest;
+        REQUIRE(ch.drain(rest) == 3);
+        REQUIRE(rest == std::vector<int>({4, 5, 6}));
+    }
+
+    SECTION("Batches across threads") {
+        int_channel ch(16);
+        std::jthread producer([&] {
+            std::vector<int> batch(64);
+            for (int round = 0; round < 10; round++) {
+                for (int i = 0; i < 64; i++) batch[i] = round * 64 + i;
+
+                std::span<int> rest(batch);
+                while (!rest.empty()) {
+                    rest = rest.subspan(ch.send_n(rest));
+                }
+            }
+            ch.close();
+        });
+
+        std::vector<int> out(32), received;
+        while (size_t n = ch.receive_n(out)) {
+            received.insert(received.end(), out.begin(), out.begin() + n);
+        }
+
+        REQUIRE(received.size() == 640);
+        for (int i = 0; i < 640; i++) REQUIRE(received[i] == i);
+    }
+
+    SECTION("receive_n returns 0 on a closed channel") {
+        int_channel ch(2);
+        ch.close();
+
+        std::vector<int> out(2);
+        REQUIRE(ch.send_n(out) == 0);
+        REQUIRE(ch.receive_n(out) == 0);
+    }
+}
+
+TEST_CASE("Non-blocking and deadline channel operations", "[threading]") {
+    using namespace std::chrono_literals;
+
+    SECTION("try_send and try_receive never block") {
+        int_channel ch(1);
+        REQUIRE(ch.empty());
+        REQUIRE_FALSE(ch.try_receive().has_value());
+
+        REQUIRE(ch.try_send(1));
+        REQUIRE_FALSE(ch.try_send(2));
+        REQUIRE(ch.size() == 1);
+
+        REQUIRE(ch.try_receive() == 1);
+        REQUIRE(ch.empty());
+    }
+
+    SECTION("Unbuffered try_send needs a waiting receiver") {
+        int_channel ch;
+        REQUIRE_FALSE(ch.try_send(1));
+    }
+
+    SECTION("Timed operations give up") {
+        int_channel ch(1);
+        ch << 1;
+
+        auto start = std::chrono::steady_clock::now();
+        REQUIRE_FALSE(ch.send_for(2, 10ms));
+        REQUIRE(std::chrono::steady_clock::now() - start >= 10ms);
+
+        REQUIRE(ch.receive_until(std::chrono::steady_clock::now() + 10ms) == 1);
+        REQUIRE_FALSE(ch.receive_for(10ms).has_value());
+        REQUIRE_FALSE(ch.is_closed());
+    }
+
+    SECTION("Timed out sends keep the value") {
+        channel<std::string> ch;
+        std::string val(64, 'x');
+        REQUIRE_FALSE(ch.send_for(std::move(val), 1ms));
+        REQUIRE(val == std::string(64, 'x'));
+
+        channel<std::string> full(1);
+        full << "queued";
+        REQUIRE_FALSE(full.send_until(std::move(val), std::chrono::steady_clock::now() + 1ms));
+        REQUIRE(val == std::string(64, 'x'));
+    }
+
+    SECTION("Timed receive gets a late value") {
+        int_channel ch;
+        std::jthread sender([&] {
+            sleep_ms(5);
+            ch << 3;
+        });
+
+        REQUIRE(ch.receive_for(1s) == 3);
+    }
+}
+
+TEST_CASE("Unbuffered rendezvous", "[threading]") {
+    using namespace std::chrono_literals;
+
+    SECTION("Ping pong between two threads") {
+        int_channel ping, pong;
+        std::jthread echo([&] {
+            while (auto v = ping.receive()) {
+                pong << *v + 1;
+            }
+        });
+
+        int v = 0;
+        for (int i = 0; i < 10000; i++) {
+            ping << v;
+            v << pong;
+        }
+        ping.close();
+        REQUIRE(v == 10000);
+    }
+
+    SECTION("Parked senders hand over in order") {
+        int_channel ch;
+        std::vector<std::jthread> senders;
+        for (int i = 0; i < 4; i++) {
+            senders.emplace_back([&, i] { ch << i; });
+
+            // wait for each sender to park so the arrival order is known
+            while (true) {
+                std::lock_guard l(ch._mu);
+                if (ch._parked_senders.count == size_t(i + 1)) break;
+            }
+        }
+
+        for (int i = 0; i < 4; i++) {
+            REQUIRE(ch.receive() == i);
+        }
+    }
+
+    SECTION("Buffered channels park blocked threads") {
+        int_channel ch(1);
+        ch << 0;
+
+        std::jthread sender([&] { ch << 1; });
+        while (true) {
+            std::lock_guard l(ch._mu);
+            if (ch._parked_senders.count == 1) break;
+        }
+
+        // taking a value refills the freed slot from the parked sender
+        REQUIRE(ch.receive() == 0);
+        REQUIRE(ch.receive() == 1);
+
+        std::jthread receiver([&] { REQUIRE(ch.receive() == 2); });
+        while (true) {
+            std::lock_guard l(ch._mu);
+            if (ch._parked_receivers.count == 1) break;
+        }
+        ch << 2;
+    }
+
+    SECTION("Closing wakes parked threads") {
+        int_channel ch;
+        std::atomic<int> failed = 0;
+        {
+            std::jthread sender([&] { failed += !ch.send(1); });
+            std::jthread receiver([&] {
+                // take the parked senders value, then park again as a receiver
+                REQUIRE(ch.receive() == 1);
+                failed += !ch.receive().has_value();
+            });
+            sleep_ms(20);
+            ch.close();
+        }
+        REQUIRE(failed == 1);
+
+        int_channel parked_sender;
+        std::jthread sender([&] { failed += !parked_sender.send(2); });
+        sleep_ms(20);
+        parked_sender.close();
+        sender.join();
+        REQUIRE(failed == 2);
+    }
+
+    SECTION("Timed operations never lose values") {
+        int_channel ch;
+        std::atomic<int> sent = 0, received = 0;
+        {
+            std::jthread sender([&] {
+                for (int i = 0; i < 2000; i++) {
+                    sent += ch.send_for(i, 50us);
+                }
+            });
+            std::jthread receiver([&] {
+                for (int i = 0; i < 2000; i++) {
+                    received += ch.receive_for(50us).has_value();
+                }
+            });
+        }
+        REQUIRE(sent == received);
+    }
+}
+
+TEST_CASE("Adaptive waiting", "[threading]") {
+    using namespace std::chrono_literals;
+
+    for (spin_budget spin : {spin_budget{0, 0}, spin_budget{}, spin_budget{4096, 64}}) {
+        for (size_t capacity : {0, 1, 16}) {
+            int_channel ping(capacity, spin), pong(capacity, spin);
+            std::jthread echo([&] {
+                while (auto v = ping.receive()) {
+                    pong << *v + 1;
+                }
+            });
+
+            int v = 0;
+            for (int i = 0; i < 1000; i++) {
+                ping << v;
+                v << pong;
+            }
+            ping.close();
+            REQUIRE(v == 1000);
+        }
+
+        // spinning never outlasts a deadline by much and never skips one
+        int_channel idle(1, spin);
+        auto start = std::chrono::steady_clock::now();
+        REQUIRE_FALSE(idle.receive_for(5ms).has_value());
+        REQUIRE(std::chrono::steady_clock::now() - start >= 5ms);
+    }
+}
+
+TEST_CASE("Buffered channel storage", "[threading]") {
+    SECTION("Steady state traffic does not allocate") {
+        channel<std::string> ch(8);
+        std::vector<std::string> out(4);
+
+        // strings short enough for the small buffer so only the channel could allocate
+        auto traffic = [&] {
+            for (int round = 0; round < 1000; round++) {
+                for (int i = 0; i < 8; i++) {
+                    ch << std::string("value");
+                }
+                for (int i = 0; i < 4; i++) {
+                    REQUIRE(ch.try_receive() == "value");
+                }
+                for (int i = 0; i < 4; i++) {
+                    REQUIRE(ch.try_send(std::string("value")));
+                }
+                REQUIRE(ch.receive_n(out) == 4);
+                REQUIRE(ch.receive_for(std::chrono::milliseconds(1)) == "value");
+                while (ch.try_receive()) {
+                }
+            }
+        };
+
+        traffic();
+        size_t before = thread_allocations;
+        traffic();
+        REQUIRE(thread_allocations == before);
+    }
+
+    SECTION("Values are destroyed in place") {
+        auto tracked = std::make_shared<int>(0);
+        {
+            channel<std::shared_ptr<int>> ch(4);
+            ch << tracked;
+            ch << tracked;
+            REQUIRE(tracked.use_count() == 3);
+
+            ch.receive();
+            REQUIRE(tracked.use_count() == 2);
+        }
+        REQUIRE(tracked.use_count() == 1);
+    }
+
+    SECTION("Unbuffered channels grow the ring on demand") {
+        int_channel ch;
+        std::atomic<int> sum = 0;
+        std::vector<std::jthread> receivers;
+        for (int i = 0; i < 4; i++) {
+            receivers.emplace_back([&] { sum += *ch.receive(); });
+        }
+
+        std::vector<int> vals = {1, 2, 3, 4};
+        size_t sent = 0;
+        while (sent < vals.size()) {
+            sent += ch.send_n(std::span(vals).subspan(sent));
+        }
+        receivers.clear();
+
+        REQUIRE(sum == 10);
+    }
+}
+
+static co_task receive_one(int_channel& ch, std::atomic<long long>& sum, std::latch& done) {
+    if (auto v = co_await ch.async_receive()) sum += *v;
+    done.count_down();
+}
+
+static co_task send_range(int_channel& ch, int from, int to) {
+    for (int i = from; i < to; i++) {
+        if (!co_await ch.async_send(i)) break;
+    }
+}
+
+static co_task relay(int_channel& in, int_channel& out) {
+    while (auto v = co_await in.async_receive()) {
+        co_await out.async_send(*v * 2);
+    }
+    out.close();
+}
+
+TEST_CASE("Coroutines", "[threading]") {
+    SECTION("100k parked coroutines") {
+        constexpr int count = 100000;
+        thread_pool pool(4);
+        int_channel ch;
+        std::atomic<long long> sum = 0;
+        std::latch done(count);
+
+        for (int i = 0; i < count; i++) {
+            REQUIRE(go_co(receive_one(ch, sum, done), &pool));
+        }
+
+        // every coroutine ends up suspended on the channel without holding a thread
+        while (true) {
+            std::lock_guard l(ch._mu);
+            if (ch._parked_receivers.count == count) break;
+        }
+
+        auto footprint = co_task_footprint();
+        std::println(
+            "{} parked coroutines use {} bytes ({} per frame)", footprint.frames, footprint.bytes,
+            footprint.bytes / footprint.frames
+        );
+        REQUIRE(footprint.frames == count);
+
+        for (int i = 0; i < count; i++) {
+            ch << i;
+        }
+        done.wait();
+
+        REQUIRE(sum == (long long)count * (count - 1) / 2);
+    }
+
+    SECTION("Coroutines and threads share a channel") {
+        thread_pool pool(2);
+        int_channel in(4), out;
+
+        REQUIRE(go_co(send_range(in, 0, 1000), &pool));
+        REQUIRE(go_co(relay(in, out), &pool));
+
+        long long sum = 0;
+        int received = 0;
+        for (int v : out) {
+            sum += v;
+            // the relay closes 'out' once 'in' is closed
+            if (++received == 1000) in.close();
+        }
+
+        REQUIRE(received == 1000);
+        REQUIRE(sum == 999 * 1000);
+    }
+
+    SECTION("Closing wakes parked coroutines") {
+        thread_pool pool(1);
+        int_channel ch;
+        std::atomic<long long> sum = 0;
+        std::latch done(10);
+
+        for (int i = 0; i < 10; i++) {
+            REQUIRE(go_co(receive_one(ch, sum, done), &pool));
+        }
+        ch.close();
+        done.wait();
+
+        REQUIRE(sum == 0);
+    }
+}
+
+TEST_CASE("Wait groups and parallel loops", "[threading]") {
+    thread_pool pool(4);
+
+    SECTION("wait_group waits for every task") {
+        wait_group wg;
+        std::atomic<int> counter = 0;
+        for (int i = 0; i < 100; i++) {
+            REQUIRE(wg.go([&] { counter++; }, &pool));
+        }
+        wg.wait();
+        REQUIRE(counter == 100);
+    }
+
+#ifdef QK_UTILS
+    SECTION("error_group keeps the first error and cancels the rest") {
+        using qk::utils::Result;
+        thread_pool single(1);
+        error_group<std::string> g(&single);
+        std::atomic<int> ran = 0;
+
+        g.go([&]() -> Result<int, std::string> {
+            ran++;
+            return std::string("failed");
+        });
+        for (int i = 0; i < 10; i++) {
+            g.go([&](std::stop_token stop) -> Result<int, std::string> {
+                ran++;
+                return stop.stop_requested() ? 0 : 1;
+            });
+        }
+
+        auto e = g.wait();
+        REQUIRE(e == "failed");
+        REQUIRE(ran == 1);
+    }
+
+    SECTION("error_group without errors") {
+        using qk::utils::Result;
+        error_group<std::string> g(&pool);
+        for (int i = 0; i < 10; i++) {
+            g.go([i]() -> Result<int, std::string> { return i; });
+        }
+        REQUIRE_FALSE(g.wait().has_value());
+    }
+#endif
+
+    SECTION("parallel_for visits every element once") {
+        std::vector<int> values(10007, 0);
+        parallel_for(values, 64, [](int& v) { v++; }, &pool);
+        REQUIRE(std::ranges::all_of(values, [](int v) { return v == 1; }));
+
+        std::vector<std::atomic<int>> hits(1000);
+        parallel_for(
+            std::views::iota(size_t(0), hits.size()), 0, [&](size_t i) { hits[i]++; }, &pool
+        );
+        REQUIRE(std::ranges::all_of(hits, [](auto& h) { return h.load() == 1; }));
+    }
+
+    SECTION("parallel_for nested inside pool tasks") {
+        std::atomic<int> total = 0;
+        parallel_for(
+            std::views::iota(0, 8), 1,
+            [&](int) { parallel_for(std::views::iota(0, 100), 10, [&](int) { total++; }, &pool); },
+            &pool
+        );
+        REQUIRE(total == 800);
+    }
+
+    SECTION("parallel_reduce") {
+        std::vector<long long> values(100000);
+        std::iota(values.begin(), values.end(), 1);
+
+        auto sum =
+            parallel_reduce(values, 0, 0LL, [](long long v) { return v; }, std::plus<>{}, &pool);
+        REQUIRE(sum == 100000LL * 100001 / 2);
+
+        // chunks are folded in order, so non commutative reductions work
+        auto joined = parallel_reduce(
+            std::views::iota(0, 20), 3, std::string(), [](int i) { return std::to_string(i % 10); },
+            std::plus<>{}, &pool
+        );
+        REQUIRE(joined == "01234567890123456789");
+
+        REQUIRE(parallel_reduce(std::vector<int>{}, 0, 7, [](int v) { return v; }) == 7);
+
+        // 'init' is folded in once, not once per chunk
+        auto offset = parallel_reduce(values, 1000, 5LL, [](long long v) { return v; });
+        REQUIRE(offset == 100000LL * 100001 / 2 + 5);
+    }
+}
+
+TEST_CASE("Timers", "[threading]") {
+    using clock = std::chrono::steady_clock;
+    using std::chrono::milliseconds;
+
+    SECTION("after fires once and never early") {
+        auto start = clock::now();
+        auto t = after(milliseconds(20));
+        auto fired = t->receive();
+        REQUIRE(fired.has_value());
+        REQUIRE(*fired - start >= milliseconds(20));
+        REQUIRE(clock::now() - start >= milliseconds(20));
+
+        REQUIRE_FALSE(t->stop());
+        REQUIRE_FALSE(t->try_receive().has_value());
+    }
+
+    SECTION("ticker fires repeatedly until stopped") {
+        auto t = ticker(milliseconds(2));
+        clock::time_point last{};
+        for (int i = 0; i < 5; i++) {
+            auto tick = t->receive();
+            REQUIRE(tick.has_value());
+            REQUIRE(*tick > last);
+            last = *tick;
+        }
+        REQUIRE(t->stop());
+
+        t->try_receive();
+        sleep_ms(10);
+        REQUIRE_FALSE(t->try_receive().has_value());
+    }
+
+    SECTION("stopped and reset timers") {
+        auto t = after(milliseconds(5));
+        REQUIRE(t->stop());
+        sleep_ms(15);
+        REQUIRE_FALSE(t->try_receive().has_value());
+
+        REQUIRE_FALSE(t->reset(milliseconds(5)));
+        REQUIRE(t->receive().has_value());
+    }
+
+    SECTION("timeout in select") {
+        channel<int> never;
+        auto timeout = after(milliseconds(10));
+
+        bool timed_out = false;
+        select(case_recv(never, [] {}), case_recv(*timeout, [&] { timed_out = true; }));
+        REQUIRE(timed_out);
+    }
+
+    SECTION("100k pending timers") {
+        size_t before = pending_timers();
+
+        std::vector<std::unique_ptr<timer>> timers;
+        timers.reserve(100000);
+        for (int i = 0; i < 100000; i++) {
+            timers.push_back(after(std::chrono::seconds(1 + i % 3600)));
+        }
+        REQUIRE(pending_timers() == before + 100000);
+
+        // a short timer still fires on time with the wheel full of long ones
+        auto start = clock::now();
+        REQUIRE(after(milliseconds(5))->receive().has_value());
+        REQUIRE(clock::now() - start < std::chrono::seconds(1));
+
+        for (size_t i = 0; i < timers.size(); i += 2) {
+            REQUIRE(timers[i]->stop());
+        }
+        REQUIRE(pending_timers() == before + 50000);
+
+        timers.clear();
+        REQUIRE(pending_timers() == before);
+    }
+}
+
+TEST_CASE("Cancellation contexts", "[threading]") {
+    using namespace std::chrono_literals;
+
+    auto parked = [](auto& ch, size_t receivers, size_t senders) {
+        while (true) {
+            std::lock_guard l(ch._mu);
+            if (ch._parked_receivers.count == receivers && ch._parked_senders.count == senders) {
+                return;
+            }
+        }
+    };
+
+    SECTION("Context tree") {
+        auto parent = with_cancel();
+        auto child = with_cancel(parent);
+        auto sibling = with_timeout(parent, 1h);
+        REQUIRE(background().err() == context_error::none);
+        REQUIRE_FALSE(child.done());
+
+        child.cancel();
+        REQUIRE(child.err() == context_error::cancelled);
+        REQUIRE_FALSE(parent.done());
+        REQUIRE_FALSE(sibling.done());
+
+        parent.cancel();
+        REQUIRE(sibling.err() == context_error::cancelled);
+        REQUIRE(with_cancel(parent).done());
+
+        auto expired = with_timeout({}, 0ms);
+        REQUIRE(expired.err() == context_error::deadline_exceeded);
+        REQUIRE(with_timeout(expired, 1h).deadline() == expired.deadline());
+    }
+
+    SECTION("Cancelling wakes only its own waiters") {
+        for (size_t capacity : {0, 4}) {
+            int_channel ch(capacity);
+            auto ctx = with_cancel();
+            std::optional<int> cancelled = 1, kept;
+            {
+                std::jthread a([&] { cancelled = ch.receive(ctx); });
+                parked(ch, 1, 0);
+                std::jthread b([&] { kept = ch.receive(with_cancel()); });
+                parked(ch, 2, 0);
+
+                ctx.cancel();
+                a.join();
+                REQUIRE_FALSE(cancelled.has_value());
+                parked(ch, 1, 0);
+
+                ch << 7;
+            }
+            REQUIRE(kept == 7);
+            REQUIRE_FALSE(ch.is_closed());
+
+            // a sender blocked on a full channel gives up without its value being sent
+            for (size_t i = 0; i < capacity; i++) {
+                ch << int(i);
+            }
+            auto send_ctx = with_cancel();
+            bool sent = true;
+            {
+                std::jthread c([&] { sent = ch.send(42, send_ctx); });
+                parked(ch, 0, 1);
+                send_ctx.cancel();
+            }
+            REQUIRE_FALSE(sent);
+            REQUIRE(ch.size() == capacity);
+            REQUIRE_FALSE(ch.send(1, send_ctx));
+        }
+    }
+
+    SECTION("Deadlines") {
+        int_channel ch(1);
+        auto ctx = with_timeout({}, 20ms);
+        auto start = std::chrono::steady_clock::now();
+        REQUIRE_FALSE(ch.receive(ctx).has_value());
+        REQUIRE(std::chrono::steady_clock::now() - start >= 20ms);
+        REQUIRE(ctx.err() == context_error::deadline_exceeded);
+    }
+
+    SECTION("Cancelling a wait that just timed out") {
+        constexpr int rounds = 20;
+        int_channel ch;
+        std::array<context, rounds> contexts;
+        std::atomic<int> started = 0, finished = 0;
+        std::atomic_bool abort = false;
+        std::optional<int> got;
+
+        std::jthread worker([&] {
+            for (int i = 0; i <= rounds; i++) {
+                while (started <= i) {
+                    if (abort) return;
+                    std::this_thread::yield();
+                }
+
+                // a stray wakeup left on this threads parker would end the last receive early
+                if (i == rounds)
+                    got = ch.receive();
+                else if (i % 2)
+                    ch.receive(contexts[i]);
+                else
+                    ch.send(i, contexts[i]);
+                finished = i + 1;
+            }
+        });
+
+        bool consistent = true;
+        for (int i = 0; i < rounds && consistent; i++) {
+            contexts[i] = with_timeout({}, 20ms);
+            started = i + 1;
+
+            // the wait times out while the channel is locked, so it races the cancellation below
+            // for the lock once it is released
+            std::unique_lock l(ch._mu);
+            while (ch._parked_receivers.count + ch._parked_senders.count == 0 && finished <= i) {
+                l.unlock();
+                std::this_thread::yield();
+                l.lock();
+            }
+            std::this_thread::sleep_until(*contexts[i].deadline() + 5ms);
+            {
+                std::jthread canceller([&] { contexts[i].cancel(); });
+                sleep_ms(5);
+                l.unlock();
+            }
+            while (finished <= i) {
+                std::this_thread::yield();
+            }
+
+            l.lock();
+            consistent = ch._parked_receivers.empty() && ch._parked_receivers.count == 0 &&
+                         ch._parked_senders.empty() && ch._parked_senders.count == 0;
+        }
+        if (!consistent) abort = true;
+        REQUIRE(consistent);
+
+        started = rounds + 1;
+        parked(ch, 1, 0);
+        ch << 7;
+        worker.join();
+        REQUIRE(got == 7);
+    }
+
+    SECTION("Cancelling a pipeline through go") {
+        int_channel jobs, results;
+        auto ctx = with_cancel();
+        std::atomic<int> exited = 0;
+        for (int i = 0; i < 4; i++) {
+            go(ctx, [&](const context& ctx) {
+                while (auto job = jobs.receive(ctx)) {
+                    if (!results.send(*job * 2, ctx)) break;
+                }
+                exited++;
+            });
+        }
+
+        jobs << 1;
+        REQUIRE(results.receive() == 2);
+
+        ctx.cancel();
+        while (exited < 4) {
+            std::this_thread::yield();
+        }
+        REQUIRE_FALSE(jobs.is_closed());
+
+        bool ran = false;
+        go(ctx, [&] { ran = true; });
+        sleep_ms(10);
+        REQUIRE_FALSE(ran);
+    }
+}
+
+TEST_CASE("Runtime instrumentation", "[threading]") {
+    SECTION("Channel counters") {
+        int_channel ch(2);
+        ch << 1;
+        ch << 2;
+        std::optional<int> last;
+        {
+            // blocks until the receive below makes room
+            std::jthread sender([&] { ch << 3; });
+            sleep_ms(10);
+            ch.receive();
+            ch.receive();
+            last = ch.receive();
+        }
+        REQUIRE(last == 3);
+
+        channel_stats stats = ch.stats();
+#ifdef QK_THREADING_STATS
+        REQUIRE(stats.sends == 3);
+        REQUIRE(stats.receives == 3);
+        REQUIRE(stats.high_water == 2);
+        REQUIRE(stats.send_blocked > std::chrono::milliseconds(5));
+#else
+        REQUIRE(stats.sends == 0);
+        REQUIRE(stats.high_water == 0);
+#endif
+
+        std::string json = to_json(stats);
+        REQUIRE(json.starts_with("{\"sends\":"));
+        REQUIRE(json.find("\"contended\":") != std::string::npos);
+        REQUIRE(json.ends_with("}"));
+    }
+
+    SECTION("Goroutine registry") {
+        int_channel gate;
+        std::atomic<bool> finished = false;
+        go([&] {
+            gate.receive();
+            finished = true;
+        });
+
+#ifdef QK_THREADING_STATS
+        std::vector<goroutine_info> live;
+        while (true) {
+            live = goroutines();
+            if (!live.empty() && live.back().state == goroutine_state::receiving) break;
+            std::this_thread::yield();
+        }
+        REQUIRE(std::string_view(live.back().site.file_name()).ends_with("threading_test.cpp"));
+
+        std::string json = to_json(live);
+        REQUIRE(json.find("\"state\":\"receiving\"") != std::string::npos);
+        REQUIRE(json.find("\"line\":") != std::string::npos);
+#else
+        REQUIRE(goroutines().empty());
+        REQUIRE(to_json(goroutines()) == "[]");
+#endif
+
+        gate << 1;
+        while (!finished) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+TEST_CASE("Broadcast channel", "[threading]") {
+    SECTION("Every subscriber sees every value in order") {
+        broadcast_channel<int> ch(16);
+        std::vector<std::unique_ptr<broadcast_channel<int>::subscriber>> subs;
+        for (int i = 0; i < 3; i++) {
+            subs.push_back(ch.subscribe());
+        }
+
+        std::atomic<int> in_order = 0;
+        {
+            std::vector<std::jthread> readers;
+            for (auto& sub : subs) {
+                readers.emplace_back([&, s = sub.get()] {
+                    int expected = 0;
+                    while (auto v = s->receive()) {
+                        if (*v != expected++) return;
+                    }
+                    if (expected == 10000) in_order++;
+                });
+            }
+
+            for (int i = 0; i < 10000; i++) {
+                REQUIRE(ch.send(i));
+            }
+            ch.close();
+        }
+        REQUIRE(in_order == 3);
+        REQUIRE_FALSE(ch.send(1));
+    }
+
+    SECTION("Blocking waits for the slowest subscriber") {
+        broadcast_channel<int> ch(4);
+        auto fast = ch.subscribe();
+        auto slow = ch.subscribe();
+
+        std::atomic<int> sent = 0;
+        {
+            std::jthread sender([&] {
+                for (int i = 0; i < 5; i++) {
+                    ch.send(i);
+                    sent++;
+                }
+            });
+            for (int i = 0; i < 4; i++) {
+                REQUIRE(fast->receive() == i);
+            }
+            sleep_ms(10);
+            REQUIRE(sent == 4);
+            REQUIRE(slow->receive() == 0);
+        }
+        REQUIRE(sent == 5);
+        REQUIRE(fast->receive() == 4);
+
+        // dropping the slow subscriber releases a blocked sender as well
+        std::jthread sender([&] { ch.send(5); });
+        sleep_ms(10);
+        REQUIRE(slow->pending() == 4);
+        slow.reset();
+        sender.join();
+        REQUIRE(fast->receive() == 5);
+    }
+
+    SECTION("Dropping and reporting overruns") {
+        broadcast_channel<std::string> dropping(4, lag_policy::drop);
+        broadcast_channel<std::string> reporting(4, lag_policy::report);
+        auto a = dropping.subscribe();
+        auto b = reporting.subscribe();
+
+        for (int i = 0; i < 10; i++) {
+            REQUIRE(dropping.send(std::to_string(i)));
+            REQUIRE(reporting.send(std::to_string(i)));
+        }
+
+        REQUIRE(a->receive() == "6");
+        REQUIRE(a->take_missed() == 6);
+
+        REQUIRE_FALSE(b->receive().has_value());
+        REQUIRE(b->take_missed() == 6);
+        REQUIRE(b->receive() == "6");
+        REQUIRE(b->take_missed() == 0);
+
+        // late subscribers only see new values
+        auto late = reporting.subscribe();
+        REQUIRE_FALSE(late->try_receive().has_value());
+        reporting.send("10");
+        REQUIRE(late->receive() == "10");
+
+        reporting.close();
+        for (std::string expected : {"7", "8", "9", "10"}) {
+            REQUIRE(b->receive() == expected);
+        }
+        REQUIRE_FALSE(b->receive().has_value());
+        REQUIRE(b->take_missed() == 0);
+    }
+
+    SECTION("Overwriting values while lagging subscribers read them") {
+        broadcast_channel<std::string> ch(2, lag_policy::drop);
+        std::vector<std::unique_ptr<broadcast_channel<std::string>::subscriber>> subs;
+        for (int i = 0; i < 4; i++) {
+            subs.push_back(ch.subscribe());
+        }
+
+        std::atomic<bool> valid = true;
+        {
+            std::vector<std::jthread> readers;
+            for (auto& sub : subs) {
+                readers.emplace_back([&, s = sub.get()] {
+                    long last = -1;
+                    while (auto v = s->receive()) {
+                        long n = std::stol(*v);
+                        if (n <= last) valid = false;
+                        last = n;
+                    }
+                });
+            }
+            for (int i = 0; i < 20000; i++) {
+                ch.send(std::string(32, 'x').replace(0, 8, std::to_string(i)));
+            }
+            ch.close();
+        }
+        REQUIRE(valid);
+    }
+}
+
+TEST_CASE("Pipelines", "[threading]") {
+    SECTION("Every value goes through every stage") {
+        std::vector<int> input(1000);
+        std::iota(input.begin(), input.end(), 0);
+
+        std::atomic<long> sum = 0;
+        std::atomic<int> count = 0;
+        auto report = pipeline(input, 8)
+                          .stage([](int v) { return v * 2; }, 4)
+                          .stage([](int v) { return std::to_string(v); }, 2)
+                          .sink([&](std::string s) {
+                              sum += std::stol(s);
+                              count++;
+                          });
+
+        REQUIRE(count == 1000);
+        REQUIRE(sum == 999 * 1000);
+
+        REQUIRE(report.stages.size() == 4);
+        REQUIRE(report.stages[0].workers == 1);
+        REQUIRE(report.stages[1].workers == 4);
+        REQUIRE(report.stages[2].workers == 2);
+        for (auto& s : report.stages) {
+            REQUIRE(s.items == 1000);
+            REQUIRE(s.queue_max <= 8);
+            REQUIRE(s.elapsed <= report.elapsed);
+        }
+        REQUIRE(report.stages[0].capacity == 0);
+        REQUIRE(report.stages[1].capacity == 8);
+    }
+
+    SECTION("Generator sources and filtering stages") {
+        int next = 0;
+        std::vector<int> out;
+        auto report = pipeline([&]() -> std::optional<int> {
+                          if (next == 100) return std::nullopt;
+                          return next++;
+                      })
+                          .stage([](int v) -> std::optional<int> {
+                              if (v % 2 != 0) return std::nullopt;
+                              return v;
+                          })
+                          .sink([&](int v) { out.push_back(v); });
+
+        REQUIRE(out.size() == 50);
+        REQUIRE(std::ranges::is_sorted(out));
+        REQUIRE(report.stages[1].items == 100);
+        REQUIRE(report.stages[2].items == 50);
+    }
+
+    SECTION("Move only values and owned ranges") {
+        std::vector<std::unique_ptr<int>> input;
+        for (int i = 0; i < 10; i++) {
+            input.push_back(std::make_unique<int>(i));
+        }
+
+        int sum = 0;
+        pipeline(std::move(input))
+            .stage([](std::unique_ptr<int> p) {
+                *p += 1;
+                return p;
+            })
+            .sink([&](std::unique_ptr<int> p) { sum += *p; });
+        REQUIRE(sum == 55);
+    }
+
+    SECTION("The slowest stage is reported as the bottleneck") {
+        auto report = pipeline(std::views::iota(0, 20), 4)
+                          .stage([](int v) { return v; }, 2)
+                          .stage([](int v) {
+                              std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                              return v;
+                          })
+                          .sink([](int) {});
+
+        REQUIRE(report.bottleneck() == 2);
+        REQUIRE(report.stages[2].utilization() > 0.5);
+        REQUIRE(report.stages[2].throughput() > 0);
+    }
+}
+
+TEST_CASE("Futures", "[threading]") {
+    SECTION("Results and continuations") {
+        auto f = go_async([](int a, int b) { return a + b; }, 2, 3)
+                     .then([](int v) { return v * 10; })
+                     .then([](int v) { return std::to_string(v); });
+        REQUIRE(f.valid());
+        REQUIRE(f.get() == "50");
+        REQUIRE(!f.valid());
+
+        std::atomic<int> ran = 0;
+        auto v = go_async([&] { ran++; }).then([&] { ran++; });
+        v.get();
+        REQUIRE(ran == 2);
+    }
+
+    SECTION("Continuations stay on the pool") {
+        thread_pool pool(2);
+        std::thread::id caller = std::this_thread::get_id();
+        auto f = go_async_on(&pool, [] { return std::this_thread::get_id(); })
+                     .then([caller](std::thread::id first) {
+                         return first != caller && std::this_thread::get_id() != caller;
+                     });
+        REQUIRE(f.get());
+
+        // the continuation is added after the value is ready
+        auto ready = go_async_on(&pool, [] { return 1; });
+        ready.wait();
+        REQUIRE(ready.ready());
+        REQUIRE(std::move(ready).then([](int v) { return v + 1; }).get() == 2);
+        shutdown(&pool);
+    }
+
+    SECTION("Chaining a continuation allocates only its state") {
+        std::binary_semaphore gate(0);
+        thread_pool pool(1);
+        auto f = go_async_on(&pool, [&] {
+            gate.acquire();
+            return 7;
+        });
+
+        size_t before = thread_allocations;
+        auto g = std::move(f).then([](int v) { return v * 2; });
+        REQUIRE(thread_allocations == before + 1);
+
+        gate.release();
+        REQUIRE(g.get() == 14);
+        shutdown(&pool);
+    }
+
+    SECTION("Waiting for all of a set of futures") {
+        std::vector<future<int>> fs;
+        for (int i = 0; i < 8; i++) {
+            fs.push_back(go_async([i] {
+                sleep_ms(unsigned(8 - i));
+                return i * i;
+            }));
+        }
+        std::vector<int> all = when_all(std::move(fs)).get();
+        REQUIRE(all == std::vector<int>{0, 1, 4, 9, 16, 25, 36, 49});
+
+        REQUIRE(when_all(std::vector<future<int>>{}).get().empty());
+
+        auto one = go_async([] { return 1; });
+        auto two = go_async([] { return std::string("two"); });
+        auto [n, s] = when_all(std::move(one), std::move(two)).get();
+        REQUIRE(n == 1);
+        REQUIRE(s == "two");
+    }
+
+    SECTION("Waiting for the first of a set of futures") {
+        // the slow goroutine outlives the section
+        auto slow_gate = std::make_shared<std::binary_semaphore>(0);
+        std::vector<future<int>> fs;
+        fs.push_back(go_async([slow_gate] {
+            slow_gate->acquire();
+            return 1;
+        }));
+        fs.push_back(go_async([] { return 2; }));
+
+        auto first = when_any(std::move(fs)).get();
+        REQUIRE(first.index == 1);
+        REQUIRE(first.value == 2);
+        slow_gate->release();
+
+        REQUIRE(!when_any(std::vector<future<int>>{}).valid());
+    }
+}
+
+TEST_CASE("Object pools", "[threading]") {
+    SECTION("Objects are reused and cleared") {
+        pool<std::string> strings;
+        std::string s = strings.get();
+        s.reserve(1000);
+        s = "scratch";
+        strings.put(std::move(s));
+        REQUIRE(strings.idle() == 1);
+
+        std::string again = strings.get();
+        REQUIRE(again.empty());
+        REQUIRE(again.capacity() >= 1000);
+        REQUIRE(strings.idle() == 0);
+
+        {
+            auto leased = strings.lease();
+            leased->append("lease");
+            REQUIRE(*leased == "lease");
+        }
+        REQUIRE(strings.idle() == 1);
+        std::string kept = strings.lease().release();
+        REQUIRE(strings.idle() == 0);
+    }
+
+    SECTION("Idle objects are trimmed") {
+        pool<std::vector<int>> vecs([] { return std::vector<int>(); }, 16, std::chrono::hours(1));
+        std::vector<std::vector<int>> out;
+        for (int i = 0; i < 10; i++) {
+            out.push_back(vecs.get());
+        }
+        for (auto& v : out) {
+            vecs.put(std::move(v));
+        }
+        out.clear();
+
+        // nothing has been idle for a whole interval yet
+        vecs.trim();
+        REQUIRE(vecs.idle() == 10);
+
+        for (int i = 0; i < 4; i++) {
+            out.push_back(vecs.get());
+        }
+        for (auto& v : out) {
+            vecs.put(std::move(v));
+        }
+
+        // the 6 objects nobody took since the last trim go away
+        vecs.trim();
+        REQUIRE(vecs.idle() == 4);
+    }
+
+    SECTION("Full free lists spill into the shared list") {
+        pool<std::string> strings([] { return std::string(); }, 4, std::chrono::hours(1));
+        std::vector<std::string> held;
+        for (int i = 0; i < 8; i++) {
+            held.push_back(strings.get());
+            held.back().reserve(100);
+        }
+        for (auto& s : held) {
+            strings.put(std::move(s));
+        }
+        REQUIRE(strings.idle() == 8);
+
+        // another thread picks up what this one spilled, and drops its own list on exit
+        size_t capacity = 0;
+        std::jthread([&] { capacity = strings.get().capacity(); }).join();
+        REQUIRE(capacity >= 100);
+        REQUIRE(strings.idle() == 6);
+    }
+
+    SECTION("Buffers cycle between producer and consumer without allocating") {
+        using buffer = std::vector<std::byte>;
+        pool<buffer> buffers([] { return buffer(); }, 8, std::chrono::hours(1));
+        channel<pooled<buffer>> ch(4);
+
+        std::atomic<size_t> producer_allocations = 0;
+        std::jthread producer([&] {
+            for (int round = 0; round < 2; round++) {
+                size_t before = thread_allocations;
+                for (int i = 0; i < 2000; i++) {
+                    auto buf = buffers.lease();
+                    buf->resize(256, std::byte(i));
+                    ch.send(std::move(buf));
+                }
+                if (round == 1) producer_allocations = thread_allocations - before;
+            }
+            ch.close();
+        });
+
+        size_t received = 0;
+        size_t consumer_allocations = 0;
+        size_t before = thread_allocations;
+        while (auto buf = ch.receive()) {
+            REQUIRE((*buf)->size() == 256);
+            if (++received == 2000) before = thread_allocations;
+        }
+        consumer_allocations = thread_allocations - before;
+        producer.join();
+
+        REQUIRE(received == 4000);
+        REQUIRE(producer_allocations == 0);
+        REQUIRE(consumer_allocations == 0);
+    }
+}
+
+TEST_CASE("Rate limiting", "[threading]") {
+    using namespace std::chrono_literals;
+
+    SECTION("Token buckets allow a burst and then the steady rate") {
+        token_bucket bucket(100, 1s, 5);
+        for (int i = 0; i < 5; i++) {
+            REQUIRE(bucket.try_take());
+        }
+        REQUIRE(!bucket.try_take());
+
+        // 10 more tokens refill at 10ms each
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 10; i++) {
+            bucket.take();
+        }
+        auto took = std::chrono::steady_clock::now() - start;
+        REQUIRE(took >= 90ms);
+        REQUIRE(took < 1s);
+
+        bucket.refund(2);
+        REQUIRE(bucket.try_take(2));
+    }
+
+    SECTION("Rates shaped like qk::utils::Rate") {
+        struct rate {
+            int amount;
+            std::chrono::milliseconds interval;
+        };
+        token_bucket bucket(rate{2, 1000ms}, 2);
+        REQUIRE(bucket.try_take());
+        REQUIRE(bucket.try_take());
+        REQUIRE(!bucket.try_take());
+        REQUIRE(bucket.available() < 1);
+    }
+
+    SECTION("Cancelled waits hand their tokens back") {
+        token_bucket bucket(1, 1s, 1);
+        REQUIRE(bucket.try_take());
+
+        auto ctx = with_timeout(background(), 20ms);
+        REQUIRE(!bucket.take(1, ctx));
+
+        auto cancelled = with_cancel();
+        std::jthread canceller([&] {
+            sleep_ms(20);
+            cancelled.cancel();
+        });
+        auto start = std::chrono::steady_clock::now();
+        REQUIRE(!bucket.take(1, cancelled));
+        REQUIRE(std::chrono::steady_clock::now() - start < 500ms);
+    }
+
+    SECTION("Values leave the channel at the limited rate") {
+        rate_limited_channel<int> ch(64, 200, 1s, 4);
+        for (int i = 0; i < 20; i++) {
+            REQUIRE(ch.send(i));
+        }
+        ch.close();
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<int> got;
+        for (int v : ch) {
+            got.push_back(v);
+        }
+        auto took = std::chrono::steady_clock::now() - start;
+
+        // 4 go out as a burst, the other 16 at 5ms each
+        REQUIRE(got.size() == 20);
+        REQUIRE(std::ranges::is_sorted(got));
+        REQUIRE(took >= 75ms);
+        REQUIRE(took < 1s);
+
+        rate_limited_channel<int> limited(4, 1, 1s, 1);
+        REQUIRE(limited.try_send(1));
+        REQUIRE(limited.try_send(2));
+        REQUIRE(limited.try_receive() == 1);
+        REQUIRE(!limited.try_receive());
+        REQUIRE(limited.size() == 1);
+    }
+
+#ifdef QK_UTILS
+    SECTION("Rates parsed by qk::utils") {
+        using namespace qk::utils;
+        rate_limited_channel<int> ch(8, "10/1s"_rate, 2);
+        REQUIRE(ch.limiter().available() > 1.9);
+    }
+#endif
+}